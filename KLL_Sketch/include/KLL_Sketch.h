@@ -0,0 +1,212 @@
+#ifndef KLL_SKETCH_H
+#define KLL_SKETCH_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <algorithm>  // for sort, lower_bound, upper_bound, inplace_merge
+#include <cmath>      // for ceil, pow
+#include <functional> // for less
+#include <stdexcept>  // for invalid_argument
+#include <vector>     // for vector
+
+namespace KLL
+{
+
+/* KLL quantile sketch (Karnin, Lang, Liberty). Level h keeps items of
+ * weight 2^h; when the sketch outgrows its capacity, the lowest overfull
+ * level is sorted and every other item, starting at a random offset, is
+ * promoted to the next level. Memory is O(k log(n / k)) items for a stream
+ * of n keys and ranks are off by roughly 1.7 / k * n.
+ *
+ * Works as an approximate engine for range_queries::start: range_count()
+ * estimates how many inserted keys fall into [left, right]. Unlike the exact
+ * engines it counts every insert, duplicates included. */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Sketch
+{
+  private:
+    static constexpr double capacity_decay_ = 2.0 / 3.0;
+    static constexpr size_t min_level_capacity_ = 2;
+
+    size_t k_;
+    std::vector<std::vector<KeyT>> levels_;
+    std::vector<bool> sorted_;
+    uint64_t count_ = 0;
+    size_t retained_ = 0;
+    size_t capacity_ = 0;
+    uint64_t random_state_ = 0x9e3779b97f4a7c15ULL;
+    Compare cmp_;
+
+    bool random_bit()
+    {
+        random_state_ ^= random_state_ << 13;
+        random_state_ ^= random_state_ >> 7;
+        random_state_ ^= random_state_ << 17;
+
+        return random_state_ & 1;
+    }
+
+    size_t level_capacity(size_t level) const
+    {
+        size_t depth = levels_.size() - level - 1;
+        double capacity = std::ceil(static_cast<double>(k_) *
+                                    std::pow(capacity_decay_, static_cast<double>(depth)));
+
+        return std::max(min_level_capacity_, static_cast<size_t>(capacity));
+    }
+
+    void update_capacity()
+    {
+        capacity_ = 0;
+        for (size_t level = 0; level < levels_.size(); ++level)
+            capacity_ += level_capacity(level);
+    }
+
+    void sort_level(size_t level)
+    {
+        if (!sorted_[level])
+        {
+            std::sort(levels_[level].begin(), levels_[level].end(), cmp_);
+            sorted_[level] = true;
+        }
+    }
+
+    void add_level()
+    {
+        levels_.emplace_back();
+        sorted_.push_back(true);
+
+        update_capacity();
+    }
+
+    /* Halves the lowest overfull level into the level above it. */
+    void compress()
+    {
+        while (retained_ >= capacity_)
+        {
+            for (size_t level = 0; level < levels_.size(); ++level)
+            {
+                if (levels_[level].size() < level_capacity(level))
+                    continue;
+
+                if (level + 1 == levels_.size())
+                    add_level();
+
+                sort_level(level);
+                sort_level(level + 1);
+
+                std::vector<KeyT> &items = levels_[level];
+                std::vector<KeyT> &above = levels_[level + 1];
+
+                /* An odd item out stays behind at its own weight. */
+                size_t kept = items.size() % 2;
+                size_t before = above.size();
+
+                for (size_t id = kept + (random_bit() ? 1 : 0); id < items.size(); id += 2)
+                    above.push_back(items[id]);
+
+                retained_ -= items.size() - kept - (above.size() - before);
+                items.resize(kept);
+
+                std::inplace_merge(above.begin(),
+                                   above.begin() + static_cast<std::ptrdiff_t>(before),
+                                   above.end(), cmp_);
+                break;
+            }
+        }
+    }
+
+  public:
+    explicit Sketch(size_t k = 200)
+        : k_(std::max<size_t>(k, 8))
+    {
+        add_level();
+    }
+
+    /* Sketch whose rank error is about `relative_error` of the stream size. */
+    static Sketch with_error(double relative_error)
+    {
+        if (!(relative_error > 0.0 && relative_error < 1.0))
+            throw std::invalid_argument("KLL error must be in (0, 1)");
+
+        return Sketch(static_cast<size_t>(std::ceil(1.7 / relative_error)));
+    }
+
+    void insert(const KeyT &key)
+    {
+        levels_[0].push_back(key);
+        sorted_[0] = false;
+
+        ++count_;
+        ++retained_;
+
+        if (retained_ >= capacity_)
+            compress();
+    }
+
+    /* Folds a sketch of another shard into this one. */
+    void merge(const Sketch &other)
+    {
+        if (this == &other)
+        {
+            Sketch copy(other);
+            merge(copy);
+            return;
+        }
+
+        while (levels_.size() < other.levels_.size())
+            add_level();
+
+        for (size_t level = 0; level < other.levels_.size(); ++level)
+        {
+            levels_[level].insert(levels_[level].end(), other.levels_[level].begin(),
+                                  other.levels_[level].end());
+            sorted_[level] = sorted_[level] && other.levels_[level].empty();
+        }
+
+        count_ += other.count_;
+        retained_ += other.retained_;
+        k_ = std::max(k_, other.k_);
+
+        update_capacity();
+        compress();
+    }
+
+    /* Estimated number of inserted keys ordered before `key`, or not after
+     * it when `inclusive` is set. */
+    double rank(const KeyT &key, bool inclusive)
+    {
+        double estimate = 0;
+
+        for (size_t level = 0; level < levels_.size(); ++level)
+        {
+            sort_level(level);
+
+            const std::vector<KeyT> &items = levels_[level];
+            auto bound = inclusive
+                             ? std::upper_bound(items.begin(), items.end(), key, cmp_)
+                             : std::lower_bound(items.begin(), items.end(), key, cmp_);
+
+            estimate += static_cast<double>(bound - items.begin()) *
+                        static_cast<double>(uint64_t{1} << level);
+        }
+
+        return estimate;
+    }
+
+    size_t range_count(const KeyT &left_b, const KeyT &right_b)
+    {
+        double estimate = rank(right_b, true) - rank(left_b, false);
+
+        return estimate > 0 ? static_cast<size_t>(estimate + 0.5) : 0;
+    }
+
+    uint64_t count() const { return count_; }
+    size_t retained() const { return retained_; }
+    size_t k() const { return k_; }
+};
+
+}; // namespace KLL
+
+#endif // KLL_SKETCH_H
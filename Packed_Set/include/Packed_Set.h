@@ -0,0 +1,275 @@
+#ifndef PACKED_SET_H
+#define PACKED_SET_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t, uint32_t, uint64_t
+
+#include <algorithm>   // for partition_point, min
+#include <bit>         // for bit_width
+#include <iterator>    // for distance
+#include <optional>    // for optional, nullopt
+#include <stdexcept>   // for invalid_argument
+#include <type_traits> // for is_integral_v, is_same_v, remove_cvref_t
+#include <vector>      // for vector
+
+namespace Packed
+{
+
+/* Frozen, compressed set of integral keys for read-only archives: memory
+ * per key matters more than nanoseconds.
+ *
+ * Sorted keys are cut into blocks of block_size. A block stores the gaps
+ * between its keys with frame-of-reference bit-packing: the smallest gap
+ * goes to the index and every gap is packed as its excess over it, in as
+ * few bits as the largest excess needs. A dense run of IDs has equal gaps
+ * and packs into zero bits, so the cost is the index alone, about one bit
+ * per key; random keys cost roughly log2(range / n) + 2 bits.
+ *
+ * The index keeps the first key of every block in its own array for the
+ * binary search; blocks are full but the last, so a block's rank is its
+ * number times block_size. A rank decodes the one block it falls into, a
+ * range count the two boundary blocks. Decoding runs over a whole block
+ * without branches; the final count is a fixed-trip compare-and-add loop
+ * the compiler vectorizes even at -O2. Unpacking stays scalar, since
+ * variable-width fields need per-lane shifts that baseline x86-64 lacks. */
+template <typename KeyT>
+class Set
+{
+    static_assert(std::is_integral_v<KeyT>, "Packed::Set holds integral keys");
+
+  public:
+    static constexpr size_t block_size = 128;
+
+  private:
+    struct Block
+    {
+        uint64_t base = 0;   // smallest gap in the block
+        uint32_t offset = 0; // first word of the packed excesses
+        uint8_t width = 0;   // bits per packed excess
+    };
+
+    std::vector<KeyT> firsts_;
+    std::vector<Block> blocks_;
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+
+    /* Keys go through uint64_t so that gaps of signed keys wrap correctly. */
+    static uint64_t to_bits(KeyT key) { return static_cast<uint64_t>(key); }
+    static KeyT from_bits(uint64_t bits) { return static_cast<KeyT>(bits); }
+
+    size_t block_keys(size_t block) const
+    {
+        return std::min(block_size, size_ - block * block_size);
+    }
+
+    void pack(const std::vector<KeyT> &keys, size_t from, size_t count)
+    {
+        Block block;
+        uint64_t largest = 0;
+
+        if (count > 1)
+        {
+            block.base = ~uint64_t{0};
+
+            for (size_t id = from + 1; id < from + count; ++id)
+            {
+                uint64_t gap = to_bits(keys[id]) - to_bits(keys[id - 1]);
+                block.base = std::min(block.base, gap);
+                largest = std::max(largest, gap);
+            }
+        }
+
+        block.width = static_cast<uint8_t>(std::bit_width(largest - block.base));
+        block.offset = static_cast<uint32_t>(words_.size());
+
+        size_t bits = (count - 1) * block.width;
+        words_.resize(words_.size() + (bits + 63) / 64);
+
+        for (size_t id = 1, bit = 0; id < count; ++id, bit += block.width)
+        {
+            uint64_t excess =
+                to_bits(keys[from + id]) - to_bits(keys[from + id - 1]) - block.base;
+
+            if (block.width == 0)
+                continue;
+
+            uint64_t* word = &words_[block.offset + bit / 64];
+            size_t shift = bit % 64;
+
+            word[0] |= excess << shift;
+            if (shift + block.width > 64)
+                word[1] |= excess >> (64 - shift);
+        }
+
+        firsts_.push_back(keys[from]);
+        blocks_.push_back(block);
+    }
+
+    /* Decodes all keys of `block` into `out`; slots past the end of a short
+     * last block repeat its last key. */
+    void decode(size_t block, KeyT (&out)[block_size]) const
+    {
+        const Block &info = blocks_[block];
+        const uint64_t* words = words_.data() + info.offset;
+
+        size_t count = block_keys(block);
+        uint64_t width = info.width;
+        uint64_t mask = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+        uint64_t gaps[block_size];
+
+        /* Every block is followed by at least one word, so both reads stay
+         * in bounds. */
+        gaps[0] = 0;
+        for (size_t id = 1; id < block_size; ++id)
+        {
+            uint64_t bit = (id - 1) * width;
+            uint64_t shift = bit % 64;
+            uint64_t low = words[bit / 64] >> shift;
+            uint64_t high = (words[bit / 64 + 1] << 1) << (63 - shift);
+
+            uint64_t live = 0 - static_cast<uint64_t>(id < count);
+            gaps[id] = (((low | high) & mask) + info.base) & live;
+        }
+
+        uint64_t key = to_bits(firsts_[block]);
+        for (size_t id = 0; id < block_size; ++id)
+        {
+            key += gaps[id];
+            out[id] = from_bits(key);
+        }
+    }
+
+    /* Number of keys in `block` ordered before `key` (not after it, if
+     * `inclusive`). */
+    size_t count_in_block(size_t block, const KeyT &key, bool inclusive) const
+    {
+        KeyT decoded[block_size];
+        decode(block, decoded);
+
+        /* Keys are sorted, so the answer is the number of matches; the
+         * repeats of the last key only matter if it matches. */
+        uint32_t result = 0;
+
+        if (inclusive)
+            for (size_t id = 0; id < block_size; ++id)
+                result += !(key < decoded[id]);
+        else
+            for (size_t id = 0; id < block_size; ++id)
+                result += decoded[id] < key;
+
+        return std::min(static_cast<size_t>(result), block_keys(block));
+    }
+
+    /* Number of keys ordered before `key` (not after it, if `inclusive`). */
+    size_t count_before(const KeyT &key, bool inclusive) const
+    {
+        auto after =
+            std::partition_point(firsts_.begin(), firsts_.end(), [&](const KeyT &first)
+                                 { return inclusive ? !(key < first) : first < key; });
+
+        if (after == firsts_.begin())
+            return 0;
+
+        size_t block = static_cast<size_t>(std::distance(firsts_.begin(), after)) - 1;
+
+        return block * block_size + count_in_block(block, key, inclusive);
+    }
+
+  public:
+    Set() = default;
+
+    /* Builds the set from strictly increasing keys, such as an RB::Tree. */
+    template <typename InputIt>
+    Set(InputIt first, InputIt last)
+    {
+        std::vector<KeyT> keys(first, last);
+
+        for (size_t id = 1; id < keys.size(); ++id)
+            if (!(keys[id - 1] < keys[id]))
+                throw std::invalid_argument("Packed::Set needs strictly increasing keys");
+
+        size_ = keys.size();
+        firsts_.reserve((size_ + block_size - 1) / block_size);
+        blocks_.reserve(firsts_.capacity());
+
+        for (size_t from = 0; from < size_; from += block_size)
+            pack(keys, from, std::min(block_size, size_ - from));
+
+        /* decode() reads a whole block and one word past it. */
+        if (!blocks_.empty())
+        {
+            const Block &tail = blocks_.back();
+            words_.resize(std::max(words_.size(),
+                                   tail.offset + block_size * tail.width / 64 + 2));
+        }
+
+        words_.shrink_to_fit();
+    }
+
+    /* RB::Tree only iterates when non-const. */
+    template <typename Tree>
+        requires(!std::is_same_v<std::remove_cvref_t<Tree>, Set>)
+    explicit Set(Tree &tree)
+        : Set(tree.begin(), tree.end())
+    {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    size_t rank(const KeyT &key) const { return count_before(key, false); }
+
+    size_t range_count(const KeyT &left_b, const KeyT &right_b) const
+    {
+        if (right_b < left_b)
+            return 0;
+
+        return count_before(right_b, true) - count_before(left_b, false);
+    }
+
+    bool contains(const KeyT &key) const { return range_count(key, key) != 0; }
+
+    /* The key with `index` smaller keys, if there is one. */
+    std::optional<KeyT> select(size_t index) const
+    {
+        if (index >= size_)
+            return std::nullopt;
+
+        KeyT decoded[block_size];
+        decode(index / block_size, decoded);
+
+        return decoded[index % block_size];
+    }
+
+    /* Decodes every key, in order. */
+    std::vector<KeyT> keys() const
+    {
+        std::vector<KeyT> result;
+        result.reserve(size_);
+
+        KeyT decoded[block_size];
+        for (size_t block = 0; block < blocks_.size(); ++block)
+        {
+            decode(block, decoded);
+            result.insert(result.end(), decoded, decoded + block_keys(block));
+        }
+
+        return result;
+    }
+
+    /* Memory taken by the index and the packed blocks. */
+    size_t bytes() const
+    {
+        return sizeof(*this) + firsts_.capacity() * sizeof(KeyT) +
+               blocks_.capacity() * sizeof(Block) + words_.capacity() * sizeof(uint64_t);
+    }
+
+    double bits_per_key() const
+    {
+        return size_ == 0 ? 0
+                          : 8.0 * static_cast<double>(bytes()) / static_cast<double>(size_);
+    }
+};
+
+}; // namespace Packed
+
+#endif // PACKED_SET_H
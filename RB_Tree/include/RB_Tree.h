@@ -1,15 +1,28 @@
 #ifndef RB_TREE_H
 #define RB_TREE_H
 
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <stack>
 
 #include "log.h"
+#include "node_pool.h"
+#include "snapshot.h"
+#include "tree_dump.h"
 
 namespace RB
 {
@@ -26,6 +39,19 @@ static constexpr const char *black_ = "#1B1B1C";
 static constexpr const char *red_ = "#820007";
 }; // namespace html_colors
 
+/* Arithmetic keys under std::less compare in one instruction and without
+ * side effects, so a descent can afford to compare once per level and
+ * select the child with a conditional move instead of branching three ways
+ * on keys it cannot predict. */
+template <typename KeyT, typename Compare>
+concept Fast_Key = std::is_arithmetic_v<KeyT> &&
+                   (std::is_same_v<Compare, std::less<KeyT>> ||
+                    std::is_same_v<Compare, std::less<>>);
+
+/* Comparators such as std::less<> that order keys against other types. */
+template <typename Compare>
+concept Transparent = requires { typename Compare::is_transparent; };
+
 }; // namespace detail
 
 template <typename KeyT, typename Compare = std::less<KeyT>>
@@ -34,18 +60,20 @@ class Tree
   private:
     /* -----~ Usings ~----- */
     struct Node;
-    using NodePtr = std::unique_ptr<Node>;
 
     /* -----~ Node ~----- */
     struct Node
     {
-        KeyT value;
+        KeyT value{};
+
+        bool is_red = true;
+        size_t size = 1; // nodes in the subtree rooted here
 
         Node* right{};
         Node* left{};
         Node* parent{};
 
-        bool is_red = true;
+        Node() = default;
 
         Node(const KeyT &_value)
             : value(_value)
@@ -53,8 +81,8 @@ class Tree
 
         Node(const KeyT &_value, Node* _parent, bool _is_red = true)
             : value(_value)
-            , parent(_parent)
             , is_red(_is_red)
+            , parent(_parent)
         {}
 
         Node* get_grandp() const
@@ -92,11 +120,38 @@ class Tree
 
 	/* -----~ members ~----- */
     Node* root_ = nullptr;
-	std::vector<NodePtr> data_;
+	detail::Node_Pool<Node> data_;
 	Compare cmp_;
 
+	/* Set while root_ lives in nodes shared with clones; data_ is empty then. */
+	std::shared_ptr<detail::Node_Pool<Node>> shared_;
+
+	/* Trees smaller than this are copied by the calling thread alone. */
+	static constexpr size_t parallel_copy_size_ = size_t{1} << 16;
+
+	/* Nodes placed or freed since the nodes were last laid out in key order,
+	 * and the fraction of size() at which that triggers compact() (0: never). */
+	size_t moved_ = 0;
+	double auto_compact_ = 0;
+
     /* -----~ Iterator ~----- */
 
+    static size_t size_of(const Node* node) { return node ? node->size : 0; }
+
+    /* All ones if `flag`, else zero; for branch-free selects. */
+    static size_t mask_of(bool flag) { return size_t{0} - static_cast<size_t>(flag); }
+
+    /* `if_set` where `mask` is all ones, else `if_clear`. GCC compiles a
+     * ternary on two loaded children into a jump, so descents that mean to
+     * be branch-free select through the bits. */
+    static Node* pick(size_t mask, Node* if_set, Node* if_clear)
+    {
+        auto set = reinterpret_cast<std::uintptr_t>(if_set);
+        auto clear = reinterpret_cast<std::uintptr_t>(if_clear);
+
+        return reinterpret_cast<Node*>((set & mask) | (clear & ~mask));
+    }
+
     static Node* sub_begin(Node* node)
     {
         while (node && node->left)
@@ -184,7 +239,7 @@ class Tree
             return *this;
         }
 
-        iterator operator++(KeyT)
+        iterator operator++(int)
         {
             if (node_)
                 LOG("postincrementing iterator of value {}\n", node_->value);
@@ -207,7 +262,7 @@ class Tree
             return *this;
         }
 
-        iterator operator--(KeyT)
+        iterator operator--(int)
         {
             if (node_)
                 LOG("postdecrementing iterator of value {}\n", node_->value);
@@ -233,7 +288,8 @@ class Tree
         }
     };
 
-    iterator beign() { return iterator(sub_begin(root_)); }
+    iterator begin() { return iterator(sub_begin(root_)); }
+    iterator beign() { return begin(); }
     iterator end() { return iterator(nullptr); }
 
   private:
@@ -260,6 +316,9 @@ class Tree
 
         node->parent = pivot;
         node->parent->left = node;
+
+        pivot->size = node->size;
+        node->size = size_of(node->left) + size_of(node->right) + 1;
     }
 
     void rotate_right(Node* node)
@@ -283,27 +342,64 @@ class Tree
 
         node->parent = pivot;
         node->parent->right = node;
+
+        pivot->size = node->size;
+        node->size = size_of(node->left) + size_of(node->right) + 1;
     }
 
-    void subtree_insert(Node* cur_node, const KeyT &value)
+    /* Adds `delta` to the subtree sizes from `node` up to the root. */
+    static void resize_path(Node* node, int delta)
     {
+        for (; node; node = node->parent)
+            node->size += static_cast<size_t>(delta);
+    }
+
+    /* Returns the node holding `value`: the new one, or the one already
+     * there. */
+    Node* subtree_insert(Node* cur_node, const KeyT &value)
+    {
+        if constexpr (detail::Fast_Key<KeyT, Compare>)
+        {
+            /* One compare per level; `candidate` ends as the smallest key
+             * not before `value`, the only one that can be equal to it. */
+            Node* parent = nullptr;
+            Node* candidate = nullptr;
+            size_t right = 0;
+
+            while (cur_node)
+            {
+                parent = cur_node;
+                right = mask_of(cmp_(cur_node->value, value));
+                candidate = pick(right, candidate, cur_node);
+                cur_node = pick(right, cur_node->right, cur_node->left);
+            }
+
+            if (candidate && !cmp_(value, candidate->value))
+                return candidate;
+
+            Node* inserted_raw = data_.make(value, parent);
+
+            (right ? parent->right : parent->left) = inserted_raw;
+            resize_path(parent, 1);
+
+            fix_violation(inserted_raw);
+            return inserted_raw;
+        }
+
 		while (cur_node)
 		{
 			if (cmp_(cur_node->value, value))
 			{
 				if (cur_node->right == nullptr)
 				{
-					auto inserted_node = std::make_unique<Node>(value, cur_node);
-
-					Node* inserted_raw = inserted_node.get();
+					Node* inserted_raw = data_.make(value, cur_node);
 
 					cur_node->right = inserted_raw;
-
-					data_.push_back(std::move(inserted_node));
+					resize_path(cur_node, 1);
 
 					fix_violation(inserted_raw);
 
-					return;
+					return inserted_raw;
 				}
 
 				cur_node = cur_node->right;
@@ -313,25 +409,24 @@ class Tree
 			{
 				if (cur_node->left == nullptr)
 				{
-					auto inserted_node = std::make_unique<Node>(value, cur_node);
-
-					Node* inserted_raw = inserted_node.get();
-
-					data_.push_back(std::move(inserted_node));
+					Node* inserted_raw = data_.make(value, cur_node);
 
 					cur_node->left = inserted_raw;
+					resize_path(cur_node, 1);
 
 					fix_violation(inserted_raw);
 
-					return;
+					return inserted_raw;
 				}
 
 				cur_node = cur_node->left;
 				continue;
 			}
 
-			return;
+			return cur_node;
 		}
+
+		return nullptr;
     }
 
     void handle_black_unc(Node* cur_node)
@@ -396,102 +491,591 @@ class Tree
 
     void paint_red(Node* node) const { node->is_red = true; }
 
-    /* -----~ graphviz dump ~----- */
-    void dump_regular_nodes(Node* node, std::ostream &dump) const
+    static bool is_black(const Node* node) { return node == nullptr || !node->is_red; }
+
+    /* -----~ erase ~----- */
+
+    /* Puts `replacement` (possibly null) where `node` hangs in the tree. */
+    void transplant(Node* node, Node* replacement)
+    {
+        if (node->parent == nullptr)
+            root_ = replacement;
+        else if (node == node->parent->left)
+            node->parent->left = replacement;
+        else
+            node->parent->right = replacement;
+
+        if (replacement != nullptr)
+            replacement->parent = node->parent;
+    }
+
+    void erase_node(Node* node)
+    {
+        Node* removed = node;
+        bool removed_red = removed->is_red;
+        Node* child = nullptr;
+        Node* child_parent = nullptr;
+
+        /* The node that leaves its place is the key's successor if the key
+         * has two children; every subtree above that place shrinks. */
+        resize_path(node->left && node->right ? sub_begin(node->right)->parent
+                                              : node->parent,
+                    -1);
+
+        if (node->left == nullptr)
+        {
+            child = node->right;
+            child_parent = node->parent;
+            transplant(node, node->right);
+        }
+        else if (node->right == nullptr)
+        {
+            child = node->left;
+            child_parent = node->parent;
+            transplant(node, node->left);
+        }
+        else
+        {
+            removed = sub_begin(node->right);
+            removed_red = removed->is_red;
+            child = removed->right;
+
+            if (removed->parent == node)
+                child_parent = removed;
+            else
+            {
+                child_parent = removed->parent;
+                transplant(removed, removed->right);
+                removed->right = node->right;
+                removed->right->parent = removed;
+            }
+
+            transplant(node, removed);
+            removed->left = node->left;
+            removed->left->parent = removed;
+            removed->is_red = node->is_red;
+            removed->size = node->size;
+        }
+
+        if (!removed_red)
+            fix_erase(child, child_parent);
+
+        data_.release(node);
+    }
+
+    /* Restores the black height after a black node was unlinked above
+     * `node`, which may be null, hence the explicit parent. */
+    void fix_erase(Node* node, Node* parent)
+    {
+        while (node != root_ && is_black(node))
+        {
+            if (node == parent->left)
+            {
+                Node* sibling = parent->right;
+
+                if (sibling->is_red)
+                {
+                    paint_black(sibling);
+                    paint_red(parent);
+                    rotate_left(parent);
+                    sibling = parent->right;
+                }
+
+                if (is_black(sibling->left) && is_black(sibling->right))
+                {
+                    paint_red(sibling);
+                    node = parent;
+                    parent = node->parent;
+                    continue;
+                }
+
+                if (is_black(sibling->right))
+                {
+                    paint_black(sibling->left);
+                    paint_red(sibling);
+                    rotate_right(sibling);
+                    sibling = parent->right;
+                }
+
+                sibling->is_red = parent->is_red;
+                paint_black(parent);
+                paint_black(sibling->right);
+                rotate_left(parent);
+            }
+            else
+            {
+                Node* sibling = parent->left;
+
+                if (sibling->is_red)
+                {
+                    paint_black(sibling);
+                    paint_red(parent);
+                    rotate_right(parent);
+                    sibling = parent->left;
+                }
+
+                if (is_black(sibling->left) && is_black(sibling->right))
+                {
+                    paint_red(sibling);
+                    node = parent;
+                    parent = node->parent;
+                    continue;
+                }
+
+                if (is_black(sibling->left))
+                {
+                    paint_black(sibling->right);
+                    paint_red(sibling);
+                    rotate_left(sibling);
+                    sibling = parent->left;
+                }
+
+                sibling->is_red = parent->is_red;
+                paint_black(parent);
+                paint_black(sibling->left);
+                rotate_right(parent);
+            }
+
+            node = root_;
+        }
+
+        paint_black(node);
+    }
+
+    /* -----~ copying ~----- */
+
+    /* Where the copy of `node` goes when its subtree is laid out in key
+     * order starting at block[base]. */
+    static Node* copy_slot(const Node* node, Node* block, size_t base)
+    {
+        return block + base + size_of(node->left);
+    }
+
+    static Node* copy_node(const Node* node, Node* parent, Node* block, size_t base)
+    {
+        Node* copy = copy_slot(node, block, base);
+
+        copy->value = node->value;
+        copy->is_red = node->is_red;
+        copy->size = node->size;
+        copy->parent = parent;
+
+        return copy;
+    }
+
+    static Node* copy_subtree(const Node* node, Node* parent, Node* block, size_t base)
     {
         if (node == nullptr)
-            return;
+            return nullptr;
 
-        dump << "\t" << reinterpret_cast<size_t>(node)
-             << "[shape = Mrecord, fillcolor = \""
-             << (node->is_red ? detail::html_colors::red_
-                              : detail::html_colors::black_)
-             << "\", label =  \"{" << node << " | val: " << node->value
-             << " | {L: " << node->left << " R: " << node->right
-             << "}}"
-             << "\" ];\n";
+        Node* copy = copy_node(node, parent, block, base);
 
-        dump_regular_nodes(node->left, dump);
+        copy->left = copy_subtree(node->left, copy, block, base);
+        copy->right = copy_subtree(node->right, copy, block,
+                                   base + size_of(node->left) + 1);
 
-        dump_regular_nodes(node->right, dump);
+        return copy;
     }
 
-    void dump_connections(Node* node, std::ostream &dump) const
+    struct Copy_Task
+    {
+        const Node* node;
+        Node* parent;
+        size_t base;
+    };
+
+    /* Copies the top of the tree and leaves subtrees of at most `grain`
+     * nodes as tasks. Every copy's slot follows from the subtree sizes, so
+     * links to the subtrees can be set before they are copied. */
+    static Node* split_copy(const Node* node, Node* parent, Node* block, size_t base,
+                            size_t grain, std::vector<Copy_Task> &tasks)
     {
         if (node == nullptr)
+            return nullptr;
+
+        if (node->size <= grain)
+        {
+            tasks.push_back({node, parent, base});
+            return copy_slot(node, block, base);
+        }
+
+        Node* copy = copy_node(node, parent, block, base);
+
+        copy->left = split_copy(node->left, copy, block, base, grain, tasks);
+        copy->right = split_copy(node->right, copy, block,
+                                 base + size_of(node->left) + 1, grain, tasks);
+
+        return copy;
+    }
+
+    /* Replaces the contents with a copy of the subtree of `root`, laid out
+     * in key order in one block and copied by up to `threads` threads. */
+    void copy_from(const Node* root, unsigned threads)
+    {
+        root_ = nullptr;
+        data_.clear();
+        moved_ = 0;
+
+        if (root == nullptr)
             return;
 
-        if (node->left != nullptr)
+        Node* block = data_.allocate(root->size);
+
+        if (threads < 2 || root->size < parallel_copy_size_)
         {
-            dump << reinterpret_cast<size_t>(node) << " -> "
-                 << reinterpret_cast<size_t>(node->left) << '\n';
+            root_ = copy_subtree(root, nullptr, block, 0);
+            return;
+        }
 
-            dump_connections(node->left, dump);
+        std::vector<Copy_Task> tasks;
+        root_ = split_copy(root, nullptr, block, 0,
+                           std::max(parallel_copy_size_ / 16, root->size / (8 * threads)),
+                           tasks);
+
+        std::atomic<size_t> next_task{0};
+
+        auto worker = [&]
+        {
+            for (size_t id = next_task++; id < tasks.size(); id = next_task++)
+                copy_subtree(tasks[id].node, tasks[id].parent, block, tasks[id].base);
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned id = 1; id < threads; ++id)
+            workers.emplace_back(worker);
+
+        worker();
+
+        for (std::thread &thread : workers)
+            thread.join();
+    }
+
+    static unsigned copy_threads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /* Takes the nodes back from clones before a modification: reuses them
+     * if no clone is left, copies them otherwise. */
+    void detach()
+    {
+        if (!shared_)
+            return;
+
+        if (shared_.use_count() == 1)
+        {
+            /* Pairs with the release of the last clone that let go. */
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            data_.swap(*shared_);
+            shared_.reset();
+            return;
+        }
+
+        std::shared_ptr<detail::Node_Pool<Node>> shared = std::move(shared_);
+        copy_from(root_, copy_threads());
+    }
+
+    /* Counts nodes placed or freed out of key order; compacts once they
+     * make up the auto_compact_ fraction of the tree. */
+    void note_moved(size_t count = 1)
+    {
+        moved_ += count;
+
+        if (auto_compact_ > 0 &&
+            static_cast<double>(moved_) > auto_compact_ * static_cast<double>(size()))
+            compact();
+    }
+
+    /* Under std::less a NaN compares false against every key, so it has no
+     * place in the order: it is never stored, matches no key, and no key is
+     * before it or in a range it bounds. Comparators that order NaN
+     * themselves are left alone. */
+    template <typename Key>
+    static bool unordered(const Key &key)
+    {
+        if constexpr (std::is_floating_point_v<Key> && detail::Fast_Key<KeyT, Compare>)
+            return std::isnan(key);
+        else
+            return false;
+    }
+
+    Node* find(const KeyT &key) const
+    {
+        if (unordered(key))
+            return nullptr;
+
+        Node* cur_node = root_;
+
+        while (cur_node)
+        {
+            if (cmp_(key, cur_node->value))
+                cur_node = cur_node->left;
+            else if (cmp_(cur_node->value, key))
+                cur_node = cur_node->right;
+            else
+                return cur_node;
+        }
+
+        return nullptr;
+    }
+
+    /* -----~ lookups ~----- */
+
+    /* Lookups take any key type the comparator accepts, so transparent
+     * comparators get heterogeneous lookups from the same code.
+     *
+     * Fast keys descend to a leaf with one compare per level and select the
+     * next child and the answer through masks: a level or two more than an
+     * early exit, in exchange for no mispredicted branches on random keys.
+     * Other keys stop at an equal key, since their compares may cost more
+     * than a misprediction. */
+    template <typename Key>
+    Node* lower_node(const Key &key) const
+    {
+        Node* answer = nullptr;
+
+        if constexpr (detail::Fast_Key<KeyT, Compare>)
+        {
+            for (Node* cur_node = root_; cur_node;)
+            {
+                size_t left = mask_of(!cmp_(cur_node->value, key));
+                answer = pick(left, cur_node, answer);
+                cur_node = pick(left, cur_node->left, cur_node->right);
+            }
         }
+        else
+        {
+            for (Node* cur_node = root_; cur_node;)
+            {
+                if (cmp_(key, cur_node->value))
+                {
+                    answer = cur_node;
+                    cur_node = cur_node->left;
+                }
+                else if (cmp_(cur_node->value, key))
+                    cur_node = cur_node->right;
+                else
+                    return cur_node;
+            }
+        }
+
+        return answer;
+    }
+
+    /* Like lower_node, but an equal key sends the descent right, so other
+     * keys have no early exit and only trade the masks for branches. */
+    template <typename Key>
+    Node* upper_node(const Key &key) const
+    {
+        Node* answer = nullptr;
+
+        if constexpr (detail::Fast_Key<KeyT, Compare>)
+        {
+            for (Node* cur_node = root_; cur_node;)
+            {
+                size_t left = mask_of(cmp_(key, cur_node->value));
+                answer = pick(left, cur_node, answer);
+                cur_node = pick(left, cur_node->left, cur_node->right);
+            }
+        }
+        else
+        {
+            for (Node* cur_node = root_; cur_node;)
+            {
+                if (cmp_(key, cur_node->value))
+                {
+                    answer = cur_node;
+                    cur_node = cur_node->left;
+                }
+                else
+                    cur_node = cur_node->right;
+            }
+        }
+
+        return answer;
+    }
+
+    /* Number of keys ordered before `key` if `inclusive` is false, else not
+     * ordered after it. Stepping right from a node counts the node and its
+     * left subtree, its size minus the right child's; the child's part is
+     * taken off once inside it, so the loop never loads a null child's
+     * size, which is the one null check a sentinel leaf would save. */
+    template <typename Key>
+    size_t keys_before(const Key &key, bool inclusive = false) const
+    {
+        if (unordered(key))
+            return 0;
+
+        size_t result = 0;
+        size_t came_right = 0;
 
-        if (node->right != nullptr)
+        for (Node* cur_node = root_; cur_node;)
         {
-            dump << reinterpret_cast<size_t>(node) << " -> "
-                 << reinterpret_cast<size_t>(node->right) << '\n';
+            size_t size = cur_node->size;
+            size_t right = mask_of(inclusive ? !cmp_(key, cur_node->value)
+                                             : cmp_(cur_node->value, key));
 
-            dump_connections(node->right, dump);
+            result += (size & right) - (size & came_right);
+            came_right = right;
+            cur_node = pick(right, cur_node->right, cur_node->left);
         }
+
+        return result;
     }
 
+    /* -----~ bulk build ~----- */
 
-  public:
-	/* -----~ public member-functions ~----- */
-	Tree() = default;
+    /* Builds a perfectly balanced subtree over keys [first, first + count).
+     * Only the deepest level is painted red, which keeps the black height
+     * equal on every path regardless of whether that level is full. */
+    template <typename RandomIt>
+    Node* build_sorted(RandomIt first, size_t count, Node* parent,
+                       size_t depth, size_t red_depth)
+    {
+        if (count == 0)
+            return nullptr;
 
-	Tree(const Tree &other)
-	{
-		MSG("Copy constructor called\n");
+        size_t mid = count / 2;
+        RandomIt middle = std::next(first, static_cast<std::ptrdiff_t>(mid));
 
-		if (!other.root_) return;
+        Node* node = data_.make(*middle, parent,
+                                depth != 0 && depth == red_depth);
 
-		struct NodeContext
-		{
-			Node* original;
-			Node* copy;
-		};
+        node->size = count;
+        node->left = build_sorted(first, mid, node, depth + 1, red_depth);
+        node->right = build_sorted(std::next(middle), count - mid - 1, node,
+                                   depth + 1, red_depth);
 
-		std::stack<NodeContext> stack;
+        return node;
+    }
 
-		auto root = std::make_unique<Node>(other.root_->value, nullptr, other.root_->is_red);
-		root_ = root.get();
-		data_.push_back(std::move(root));
+    /* Returns the black height of the subtree, or -1 if it breaks ordering,
+     * parent links, subtree sizes or red-black rules. */
+    long check_subtree(const Node* node, const Node* parent) const
+    {
+        if (node == nullptr)
+            return 0;
 
-		stack.push({other.root_, root_});
+        if (node->parent != parent)
+            return -1;
 
-		while (!stack.empty())
-		{
-			NodeContext ctxt = stack.top();
-			stack.pop();
+        if (node->is_red && parent && parent->is_red)
+            return -1;
 
-			if (ctxt.original->left)
-			{
-				auto left =
-					std::make_unique<Node>(	ctxt.original->left->value,
-											ctxt.copy,
-											ctxt.original->left->is_red);
-				ctxt.copy->left = left.get();
-				data_.push_back(std::move(left));
-
-				stack.push({ctxt.original->left, ctxt.copy->left});
-			}
+        if (node->size != size_of(node->left) + size_of(node->right) + 1)
+            return -1;
 
-			if (ctxt.original->right)
-			{
-				auto right =
-					std::make_unique<Node>(	ctxt.original->right->value,
-											ctxt.copy,
-											ctxt.original->right->is_red);
-				ctxt.copy->right = right.get();
-				data_.push_back(std::move(right));
-
-				stack.push({ctxt.original->right, ctxt.copy->right});
-			}
-		}
+        if ((node->left && !cmp_(node->left->value, node->value)) ||
+            (node->right && !cmp_(node->value, node->right->value)))
+            return -1;
+
+        long left_height = check_subtree(node->left, node);
+        long right_height = check_subtree(node->right, node);
+
+        if (left_height < 0 || left_height != right_height)
+            return -1;
+
+        return left_height + (node->is_red ? 0 : 1);
+    }
+
+    /* -----~ graphviz dump ~----- */
+
+    static size_t dump_id(const Node* node) { return reinterpret_cast<size_t>(node); }
+
+    /* Whether the subtree of `node`'s left (or right) child may hold keys in
+     * the focus range. */
+    bool in_focus(const Node* node, bool left, const Dump_Options<KeyT> &options) const
+    {
+        if (left)
+            return !options.focus_from || cmp_(*options.focus_from, node->value);
+
+        return !options.focus_to || cmp_(node->value, *options.focus_to);
+    }
+
+    /* Breadth-first and without recursion: a level is drawn from the nodes
+     * the level above expanded, so memory follows the drawing, not the
+     * tree, and sampling picks every sample_every-th node of a level. */
+    void write_dot(std::ostream &out, const Dump_Options<KeyT> &options) const
+    {
+        detail::Dump_Writer dump(out);
+
+        dump << "digraph BinaryTree {\n"
+                "bgcolor = \"" << detail::html_colors::blue_gray_ << "\";\n"
+                "edge[minlen = 3, penwidth = 3; color = \"black\"];\n"
+                "node[shape = \"rectangle\", style = \"rounded, filled\",\n"
+                "\tfillcolor = \"" << detail::html_colors::coral_pink_ << "\",\n"
+                "\tfontsize = 30,\n"
+                "\theight = 3,\n"
+                "\tpenwidth = 5, color = \"white\", fontcolor = \"white\"];\n";
+
+        dump << "{rank = min;\n"
+                "\tlist_manager [shape = Mrecord, fillcolor = \""
+             << detail::html_colors::navy_blue_ << "\", label = \"{ROOT | size: "
+             << size() << "}\"];\n"
+                "}\n";
+
+        std::vector<const Node*> level;
+        std::vector<const Node*> next_level;
+        size_t sample_every = std::max<size_t>(1, options.sample_every);
+
+        if (root_)
+        {
+            level.push_back(root_);
+            dump << "list_manager -> " << dump_id(root_) << '\n';
+        }
+
+        for (size_t depth = 0; !level.empty(); ++depth)
+        {
+            size_t children = 0;
+            next_level.clear();
+
+            for (const Node* node : level)
+            {
+                dump << '\t' << dump_id(node) << " [shape = Mrecord, fillcolor = \""
+                     << (node->is_red ? detail::html_colors::red_
+                                      : detail::html_colors::black_)
+                     << "\", label = \"{val: " << node->value << " | size: "
+                     << node->size << "}\"];\n";
+
+                for (const Node* child : {node->left, node->right})
+                {
+                    if (child == nullptr)
+                        continue;
+
+                    bool expand = depth < options.max_depth &&
+                                  in_focus(node, child == node->left, options) &&
+                                  children++ % sample_every == 0;
+
+                    if (expand)
+                    {
+                        next_level.push_back(child);
+                        dump << dump_id(node) << " -> " << dump_id(child) << '\n';
+                    }
+                    else
+                        dump << "\ts" << dump_id(child) << " [label = \"" << child->size
+                             << " keys\"];\n"
+                             << dump_id(node) << " -> s" << dump_id(child) << '\n';
+                }
+            }
+
+            level.swap(next_level);
+        }
+
+        dump << "}\n";
+    }
+
+  public:
+	/* -----~ public member-functions ~----- */
+	Tree() = default;
+
+	/* Deep copy: all nodes in one block, large trees copied in parallel. */
+	Tree(const Tree &other)
+		: auto_compact_(other.auto_compact_)
+	{
+		MSG("Copy constructor called\n");
+
+		copy_from(other.root_, copy_threads());
 	}
 
 	Tree(Tree&& other) noexcept: Tree() { swap(other); }
@@ -522,113 +1106,422 @@ class Tree
 		return *this;
 	}
 
+    /* Deep copy made by at most `threads` threads. */
+    Tree copy(unsigned threads) const
+    {
+        Tree result;
+        result.copy_from(root_, threads);
+
+        return result;
+    }
+
+    /* Copy-on-write snapshot in O(1): this tree and the clone share their
+     * nodes until either of them is modified, which then copies them (or
+     * takes them back, if the other one is gone). Parent links rule out
+     * sharing single paths, so the first change pays for a full copy. */
+    Tree clone()
+    {
+        if (!shared_)
+        {
+            shared_ = std::make_shared<detail::Node_Pool<Node>>();
+            shared_->swap(data_);
+        }
+
+        Tree result;
+        result.root_ = root_;
+        result.shared_ = shared_;
+        result.moved_ = moved_;
+        result.auto_compact_ = auto_compact_;
+
+        return result;
+    }
+
+    /* True while the nodes are shared with a clone. */
+    bool is_shared() const { return shared_ != nullptr; }
+
+    /* Throws std::invalid_argument for a NaN key. */
     void insert(const KeyT &value)
     {
         LOG("Inserting {}\n", value);
 
+        if (unordered(value))
+            throw std::invalid_argument("NaN keys can't be ordered");
+
+        if (shared_)
+        {
+            if (find(value))
+                return;
+
+            detach();
+        }
+
+        size_t before = size();
+
         if (root_ == nullptr)
         {
-			auto root = std::make_unique<Node>(value);
-            root_ = root.get();
-			data_.push_back(std::move(root));
+            root_ = data_.make(value);
 
             paint_black(root_);
         }
         else
             subtree_insert(root_, value);
+
+        if (size() != before)
+            note_moved();
     }
 
-    void dump() const
+    /* Graphviz drawing of the whole tree in tree_dump.dot. */
+    void dump() const { dump("tree_dump.dot", {}); }
+
+    void dump(const std::string &path, const Dump_Options<KeyT> &options) const
     {
-        std::string file_name = "tree_dump";
-        std::ofstream dump(file_name + ".dot");
+        std::ofstream file(path);
+        if (!file.is_open())
+            throw std::runtime_error("Can't open " + path);
 
-        dump << "digraph BinaryTree {\n"
-                "bgcolor = \""
-             << detail::html_colors::blue_gray_
-             << "\";\n"
-                "edge[minlen = 3, penwidth = 3; color = \"black\"];\n"
-                "node[shape = \"rectangle\", style = \"rounded, filled\",\n"
-                "\tfillcolor = \""
-             << detail::html_colors::coral_pink_
-             << "\",\n"
-                "\tfontsize = 30,\n"
-                "\theight = 3,\n"
-                "\tpenwidth = 5, color = \"white\", fontcolor = \"white\"];\n";
+        dump(file, options);
 
-        dump << "{rank = min;\n"
-                "\tlist_manager [shape = Mrecord, fillcolor = \""
-             << detail::html_colors::navy_blue_
-             << "\", "
-                "label = \"{ROOT: "
-             << root_
-             << "}\"];\n"
-                "}\n";
+        if (!file)
+            throw std::runtime_error("Failed to write " + path);
+    }
+
+    void dump(std::ostream &out, const Dump_Options<KeyT> &options) const
+    {
+        write_dot(out, options);
+    }
+
+    /* Per-level counts, heights and balance, in one iterative pass with
+     * O(height) extra memory; see write_json(). */
+    Shape_Stats shape() const
+    {
+        Shape_Stats stats;
+
+        if (root_ == nullptr)
+            return stats;
+
+        stats.min_leaf_depth = std::numeric_limits<size_t>::max();
+        double depth_sum = 0;
 
-        if (root_ != nullptr)
-            dump_regular_nodes(root_, dump);
+        std::vector<std::pair<const Node*, size_t>> pending{{root_, 0}};
+
+        while (!pending.empty())
+        {
+            auto [node, depth] = pending.back();
+            pending.pop_back();
 
-        dump_connections(root_, dump);
+            if (stats.level_counts.size() <= depth)
+                stats.level_counts.resize(depth + 1);
 
-        dump << "}";
+            ++stats.level_counts[depth];
+            ++stats.nodes;
+            stats.red += node->is_red;
+            stats.height = std::max(stats.height, depth + 1);
+            depth_sum += static_cast<double>(depth);
+
+            if (node->left == nullptr || node->right == nullptr)
+                stats.min_leaf_depth = std::min(stats.min_leaf_depth, depth);
+
+            if (node->right)
+                pending.push_back({node->right, depth + 1});
+            if (node->left)
+                pending.push_back({node->left, depth + 1});
+        }
+
+        for (const Node* node = root_; node; node = node->left)
+            stats.black_height += !node->is_red;
+
+        stats.average_depth = depth_sum / static_cast<double>(stats.nodes);
+
+        return stats;
     }
 
-    iterator lower_bound(const KeyT &key) const
+    /* Removes `key` if present; returns the number of removed keys. */
+    size_t erase(const KeyT &key)
     {
-        Node* cur_node = root_;
-        Node* answer{};
+        Node* node = find(key);
 
-        if (!cur_node)
-            return iterator{};
+        if (node == nullptr)
+            return 0;
 
-        while (cur_node)
+        if (shared_)
         {
-            if (cmp_(key, cur_node->value))
-            {
-                answer = cur_node;
-                if (cur_node->left == nullptr)
-                    return iterator(answer);
-                cur_node = cur_node->left;
-            }
-            else if (cmp_(cur_node->value, key))
+            detach();
+            node = find(key);
+        }
+
+        LOG("Erasing {}\n", key);
+
+        erase_node(node);
+        note_moved();
+
+        return 1;
+    }
+
+    /* Inserts keys from a strictly increasing range. A batch that is large
+     * next to the tree, m log n >= n, is merged with the tree's keys and
+     * bulk-built in O(n + m). Otherwise each key starts from the node of
+     * the one before: it climbs to the lowest ancestor above it, which
+     * bounds a subtree holding the key's place, and descends from there,
+     * so keys that land close together touch few nodes. */
+    template <typename ForwardIt>
+    void insert_sorted(ForwardIt first, ForwardIt last)
+    {
+        if (first == last)
+            return;
+
+        detach();
+
+        size_t before = size();
+        size_t count = static_cast<size_t>(std::distance(first, last));
+
+        if (count * static_cast<size_t>(std::bit_width(before)) >= before)
+        {
+            std::vector<KeyT> keys;
+            keys.reserve(before + count);
+
+            for (Node* node = sub_begin(root_); node; node = next(node))
             {
-                if (cur_node->right == nullptr)
-                    return iterator(answer);
-                cur_node = cur_node->right;
+                for (; first != last && cmp_(*first, node->value); ++first)
+                    keys.push_back(*first);
+
+                if (first != last && !cmp_(node->value, *first))
+                    ++first;
+
+                keys.push_back(node->value);
             }
-            else
-                return iterator(cur_node);
+
+            keys.insert(keys.end(), first, last);
+            assign_sorted(keys.begin(), keys.end());
+            return;
+        }
+
+        for (Node* previous = nullptr; first != last; ++first)
+        {
+            Node* from = previous;
+            while (from && !cmp_(*first, from->value))
+                from = from->parent;
+
+            previous = subtree_insert(from ? from : root_, *first);
         }
 
-        return iterator(answer);
+        note_moved(size() - before);
     }
 
-    iterator upper_bound(const KeyT &key) const
+    /* Re-lays the nodes out in key order in one block, as copies are, and
+     * releases the rest of the pool: slots freed by erases and blocks
+     * filled in insertion order, which scans and descents hop across.
+     * Shared nodes are copied. Invalidates iterators. */
+    void compact(unsigned threads = copy_threads())
     {
-        Node* cur_node = root_;
-        Node* answer = nullptr;
+        detail::Node_Pool<Node> old;
+        old.swap(data_);
 
-        if (!cur_node)
-            return iterator{};
+        std::shared_ptr<detail::Node_Pool<Node>> shared = std::move(shared_);
+        copy_from(root_, threads);
+    }
+
+    /* Makes insert() and erase() call compact() once the nodes they placed
+     * or freed since the last layout exceed `fraction` of the size; each
+     * compaction then costs O(1 / fraction) per update. 0 turns it off. */
+    void set_auto_compact(double fraction)
+    {
+        if (!(fraction >= 0))
+            throw std::invalid_argument("Auto-compact fraction must be non-negative");
+
+        auto_compact_ = fraction;
+    }
+
+    /* Memory held by the node pool, including free and unused slots. */
+    size_t bytes() const { return shared_ ? shared_->bytes() : data_.bytes(); }
+
+    iterator lower_bound(const KeyT &key) const { return iterator(lower_node(key)); }
+
+    template <typename Key>
+        requires detail::Transparent<Compare>
+    iterator lower_bound(const Key &key) const
+    {
+        return iterator(lower_node(key));
+    }
+
+    iterator upper_bound(const KeyT &key) const { return iterator(upper_node(key)); }
+
+    template <typename Key>
+        requires detail::Transparent<Compare>
+    iterator upper_bound(const Key &key) const
+    {
+        return iterator(upper_node(key));
+    }
+
+    size_t size() const { return size_of(root_); }
+
+    /* -----~ order statistics ~----- */
+
+    /* Number of keys ordered before `key`. */
+    size_t rank(const KeyT &key) const { return keys_before(key); }
+
+    template <typename Key>
+        requires detail::Transparent<Compare>
+    size_t rank(const Key &key) const
+    {
+        return keys_before(key);
+    }
+
+    /* Number of keys not ordered after `key`. */
+    size_t upper_rank(const KeyT &key) const { return keys_before(key, true); }
+
+    template <typename Key>
+        requires detail::Transparent<Compare>
+    size_t upper_rank(const Key &key) const
+    {
+        return keys_before(key, true);
+    }
+
+    /* The key with `index` smaller keys (0 is the minimum), or end(). */
+    iterator select(size_t index) const
+    {
+        Node* cur_node = root_;
 
         while (cur_node)
         {
-            if (cmp_(key, cur_node->value))
-            {
-                answer = cur_node;
-                if (cur_node->left == nullptr)
-                    return iterator(answer);
+            size_t left_size = size_of(cur_node->left);
+
+            if (index < left_size)
                 cur_node = cur_node->left;
-            }
+            else if (index == left_size)
+                return iterator(cur_node);
             else
             {
-                if (cur_node->right == nullptr)
-                    return iterator(answer);
+                index -= left_size + 1;
                 cur_node = cur_node->right;
             }
         }
 
-        return iterator(answer);
+        return iterator{};
+    }
+
+    /* Nearest-rank quantile: the smallest key with at least a `fraction`
+     * of all keys not after it; the minimum for 0. end() if empty. */
+    iterator quantile(double fraction) const
+    {
+        if (!(fraction >= 0.0 && fraction <= 1.0))
+            throw std::invalid_argument("Quantile fraction must be in [0, 1]");
+
+        if (root_ == nullptr)
+            return iterator{};
+
+        double position = std::ceil(fraction * static_cast<double>(size()));
+        size_t index = position < 1 ? 0 : static_cast<size_t>(position) - 1;
+
+        return select(std::min(index, size() - 1));
+    }
+
+    /* Number of keys in [left_b, right_b], in O(log n). */
+    size_t range_count(const KeyT &left_b, const KeyT &right_b) const
+    {
+        if (unordered(left_b) || unordered(right_b) || cmp_(right_b, left_b))
+            return 0;
+
+        return keys_before(right_b, true) - keys_before(left_b);
+    }
+
+    /* Bounds of other types are not converted to KeyT first, so
+     * [0.5, 2.5] over integer keys counts 1 and 2 rather than 0 to 2. */
+    template <typename Left, typename Right>
+        requires detail::Transparent<Compare>
+    size_t range_count(const Left &left_b, const Right &right_b) const
+    {
+        if (unordered(left_b) || unordered(right_b) || cmp_(right_b, left_b))
+            return 0;
+
+        return keys_before(right_b, true) - keys_before(left_b);
+    }
+
+    /* Checks the red-black invariants; meant for tests and debugging. */
+    bool verify() const
+    {
+        if (root_ && root_->is_red)
+            return false;
+
+        return check_subtree(root_, nullptr) >= 0;
+    }
+
+    /* Replaces the contents with keys from a strictly increasing range in
+     * O(n), without a single insert or rebalancing step. */
+    template <typename RandomIt>
+    void assign_sorted(RandomIt first, RandomIt last)
+    {
+        size_t count = static_cast<size_t>(std::distance(first, last));
+
+        root_ = nullptr;
+        data_.clear();
+        shared_.reset();
+        moved_ = 0;
+
+        if (count == 0)
+            return;
+
+        size_t red_depth = 0;
+        while ((size_t{2} << red_depth) <= count)
+            ++red_depth;
+
+        data_.reserve(count);
+        root_ = build_sorted(first, count, nullptr, 0, red_depth);
+    }
+
+    /* Writes the keys in ascending order to a versioned, checksummed binary
+     * snapshot (see snapshot.h). */
+    void save(const std::string &path) const
+        requires std::is_trivially_copyable_v<KeyT>
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            throw std::runtime_error("Can't open " + path);
+
+        snapshot::Header header{};
+        std::copy(std::begin(snapshot::magic), std::end(snapshot::magic),
+                  header.magic);
+        header.version = snapshot::version;
+        header.key_size = sizeof(KeyT);
+        header.key_type = static_cast<uint32_t>(snapshot::key_type_of<KeyT>());
+        header.count = size();
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        snapshot::Checksum checksum;
+
+        for (Node* node = sub_begin(root_); node; node = next(node))
+        {
+            checksum.update(&node->value, sizeof(KeyT));
+            file.write(reinterpret_cast<const char*>(&node->value),
+                       sizeof(KeyT));
+        }
+
+        header.checksum = checksum.value();
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        if (!file)
+            throw std::runtime_error("Failed to write " + path);
+    }
+
+    /* Replaces the contents with a snapshot produced by save(). The file is
+     * mapped and the tree is bulk-built straight from the mapped keys. */
+    void load(const std::string &path)
+        requires std::is_trivially_copyable_v<KeyT>
+    {
+        snapshot::Mapped_File file(path);
+
+        size_t count = 0;
+        const KeyT* keys = snapshot::keys<KeyT>(file, path, count);
+
+        auto unordered = std::adjacent_find(keys, keys + count,
+            [this](const KeyT &lhs, const KeyT &rhs) { return !cmp_(lhs, rhs); });
+
+        if (unordered != keys + count)
+            throw std::runtime_error(path + ": snapshot keys are not sorted");
+
+        assign_sorted(keys, keys + count);
     }
 
 	void swap(Tree& other) noexcept
@@ -636,7 +1529,10 @@ class Tree
 		using std::swap;
 
 		swap(root_, other.root_);
-		swap(data_, other.data_);
+		data_.swap(other.data_);
+		swap(shared_, other.shared_);
+		swap(moved_, other.moved_);
+		swap(auto_compact_, other.auto_compact_);
 	}
 };
 
@@ -0,0 +1,122 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <stddef.h> // for size_t
+
+#include <memory>  // for unique_ptr, make_unique
+#include <utility> // for forward, swap
+#include <vector>  // for vector
+
+namespace RB
+{
+
+namespace detail
+{
+
+/* Owns the nodes of a tree in a few large blocks instead of one heap
+ * allocation per node. Node addresses are stable for the pool's lifetime;
+ * released nodes are kept on a free list and handed out again first. */
+template <typename Node>
+class Node_Pool
+{
+  private:
+    static constexpr size_t min_block_size_ = 64;
+
+    std::vector<std::unique_ptr<Node[]>> blocks_;
+    std::vector<Node*> free_;
+    size_t block_size_ = 0;
+    size_t block_used_ = 0;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+
+    void add_block(size_t block_size)
+    {
+        blocks_.push_back(std::make_unique<Node[]>(block_size));
+        block_size_ = block_size;
+        block_used_ = 0;
+        capacity_ += block_size;
+    }
+
+  public:
+    template <typename... Args>
+    Node* make(Args&&... args)
+    {
+        Node* node = nullptr;
+
+        if (!free_.empty())
+        {
+            node = free_.back();
+            free_.pop_back();
+        }
+        else
+        {
+            if (block_used_ == block_size_)
+                add_block(capacity_ > min_block_size_ ? capacity_ : min_block_size_);
+
+            node = &blocks_.back()[block_used_++];
+        }
+
+        *node = Node(std::forward<Args>(args)...);
+        ++size_;
+
+        return node;
+    }
+
+    void release(Node* node)
+    {
+        *node = Node();
+        free_.push_back(node);
+        --size_;
+    }
+
+    /* Hands out n default nodes lying next to each other. */
+    Node* allocate(size_t n)
+    {
+        reserve(n);
+
+        Node* first = &blocks_.back()[block_used_];
+        block_used_ += n;
+        size_ += n;
+
+        return first;
+    }
+
+    /* Guarantees that the next n calls to make() touch a single block. */
+    void reserve(size_t n)
+    {
+        if (block_size_ - block_used_ < n)
+            add_block(n);
+    }
+
+    void clear() noexcept
+    {
+        blocks_.clear();
+        free_.clear();
+        block_size_ = 0;
+        block_used_ = 0;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    size_t bytes() const { return capacity_ * sizeof(Node); }
+
+    void swap(Node_Pool& other) noexcept
+    {
+        using std::swap;
+
+        swap(blocks_, other.blocks_);
+        swap(free_, other.free_);
+        swap(block_size_, other.block_size_);
+        swap(block_used_, other.block_used_);
+        swap(size_, other.size_);
+        swap(capacity_, other.capacity_);
+    }
+};
+
+}; // namespace detail
+
+}; // namespace RB
+
+#endif // NODE_POOL_H
@@ -0,0 +1,249 @@
+#ifndef SHORT_STRING_H
+#define SHORT_STRING_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t
+
+#include <algorithm>   // for min
+#include <compare>     // for strong_ordering
+#include <cstring>     // for memcpy, memcmp
+#include <functional>  // for hash
+#include <istream>     // for istream
+#include <limits>      // for numeric_limits
+#include <ostream>     // for ostream
+#include <stdexcept>   // for length_error
+#include <string>      // for string
+#include <string_view> // for string_view
+#include <utility>     // for exchange
+
+namespace RB
+{
+
+/* String key that keeps short strings inside the tree node. The first
+ * prefix_size bytes are cached as two big-endian integers, so comparing two
+ * keys that differ early, which is most comparisons on a descent, takes one
+ * or two integer compares that never leave the node. Strings up to
+ * inline_capacity bytes keep the rest inline too; longer ones keep it on
+ * the heap, which is only read when the prefixes are equal. Orders like
+ * std::string: bytewise, then by length. */
+class Short_String
+{
+  public:
+    static constexpr size_t prefix_size = 2 * sizeof(uint64_t);
+    static constexpr size_t inline_capacity = 28;
+
+  private:
+    static constexpr size_t rest_capacity_ = inline_capacity - prefix_size;
+
+    uint64_t prefix_[2] = {};        // bytes [0, 16), zero padded, big-endian
+    char rest_[rest_capacity_] = {}; // bytes [16, size), or a pointer to them
+    uint32_t size_ = 0;
+
+    static uint64_t load_word(const char *chars, size_t count)
+    {
+        unsigned char bytes[sizeof(uint64_t)] = {};
+        std::memcpy(bytes, chars, std::min(count, sizeof(uint64_t)));
+
+        uint64_t word = 0;
+        for (unsigned char byte : bytes)
+            word = (word << 8) | byte;
+
+        return word;
+    }
+
+    bool on_heap() const { return size_ > inline_capacity; }
+
+    const char *heap() const
+    {
+        const char *chars = nullptr;
+        std::memcpy(&chars, rest_, sizeof(chars));
+        return chars;
+    }
+
+    const char *rest() const { return on_heap() ? heap() : rest_; }
+
+    void assign(std::string_view text)
+    {
+        if (text.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("Short_String: key too long");
+
+        size_ = static_cast<uint32_t>(text.size());
+
+        for (size_t word = 0; word < 2; ++word)
+        {
+            size_t offset = std::min(text.size(), word * sizeof(uint64_t));
+            prefix_[word] = load_word(text.data() + offset, text.size() - offset);
+        }
+
+        if (text.size() <= prefix_size)
+            return;
+
+        size_t rest = text.size() - prefix_size;
+
+        if (on_heap())
+        {
+            char *chars = new char[rest];
+            std::memcpy(chars, text.data() + prefix_size, rest);
+            std::memcpy(rest_, &chars, sizeof(chars));
+        }
+        else
+            std::memcpy(rest_, text.data() + prefix_size, rest);
+    }
+
+    void release()
+    {
+        if (on_heap())
+            delete[] heap();
+
+        size_ = 0;
+    }
+
+    void steal(Short_String &other)
+    {
+        std::memcpy(prefix_, other.prefix_, sizeof(prefix_));
+        std::memcpy(rest_, other.rest_, rest_capacity_);
+        size_ = std::exchange(other.size_, 0);
+        other.prefix_[0] = other.prefix_[1] = 0;
+    }
+
+  public:
+    Short_String() = default;
+
+    Short_String(std::string_view text) { assign(text); }
+    Short_String(const std::string &text) : Short_String(std::string_view(text)) {}
+    Short_String(const char *text) : Short_String(std::string_view(text)) {}
+
+    Short_String(const Short_String &other)
+        : size_(other.size_)
+    {
+        std::memcpy(prefix_, other.prefix_, sizeof(prefix_));
+
+        if (on_heap())
+        {
+            size_t rest = size_ - prefix_size;
+            char *chars = new char[rest];
+            std::memcpy(chars, other.heap(), rest);
+            std::memcpy(rest_, &chars, sizeof(chars));
+        }
+        else
+            std::memcpy(rest_, other.rest_, rest_capacity_);
+    }
+
+    Short_String(Short_String &&other) noexcept { steal(other); }
+
+    Short_String &operator=(const Short_String &other)
+    {
+        if (this != &other)
+        {
+            Short_String copy(other);
+            release();
+            steal(copy);
+        }
+
+        return *this;
+    }
+
+    Short_String &operator=(Short_String &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            steal(other);
+        }
+
+        return *this;
+    }
+
+    ~Short_String() { release(); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    std::string str() const
+    {
+        std::string text(size_, '\0');
+
+        for (size_t id = 0; id < std::min<size_t>(size_, prefix_size); ++id)
+        {
+            size_t shift = 8 * (sizeof(uint64_t) - 1 - id % sizeof(uint64_t));
+            text[id] = static_cast<char>((prefix_[id / sizeof(uint64_t)] >> shift) & 0xff);
+        }
+
+        if (size_ > prefix_size)
+            std::memcpy(text.data() + prefix_size, rest(), size_ - prefix_size);
+
+        return text;
+    }
+
+    friend std::strong_ordering operator<=>(const Short_String &lhs,
+                                            const Short_String &rhs)
+    {
+        if (lhs.prefix_[0] != rhs.prefix_[0])
+            return lhs.prefix_[0] <=> rhs.prefix_[0];
+
+        if (lhs.prefix_[1] != rhs.prefix_[1])
+            return lhs.prefix_[1] <=> rhs.prefix_[1];
+
+        size_t common = std::min(lhs.size_, rhs.size_);
+        if (common > prefix_size)
+        {
+            int order = std::memcmp(lhs.rest(), rhs.rest(), common - prefix_size);
+            if (order != 0)
+                return order <=> 0;
+        }
+
+        return lhs.size_ <=> rhs.size_;
+    }
+
+    friend bool operator==(const Short_String &lhs, const Short_String &rhs)
+    {
+        if (lhs.prefix_[0] != rhs.prefix_[0] || lhs.prefix_[1] != rhs.prefix_[1] ||
+            lhs.size_ != rhs.size_)
+            return false;
+
+        return lhs.size_ <= prefix_size ||
+               std::memcmp(lhs.rest(), rhs.rest(), lhs.size_ - prefix_size) == 0;
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const Short_String &key)
+    {
+        return out << key.str();
+    }
+
+    /* Reads a whitespace-separated word, like operator>> on std::string. */
+    friend std::istream &operator>>(std::istream &in, Short_String &key)
+    {
+        std::string text;
+        if (in >> text)
+            key = Short_String(text);
+
+        return in;
+    }
+
+    size_t hash() const
+    {
+        auto mix = [](size_t seed, size_t value)
+        { return seed ^ (value + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2)); };
+
+        size_t seed = std::hash<uint64_t>{}(prefix_[0] ^ size_);
+        seed = mix(seed, std::hash<uint64_t>{}(prefix_[1]));
+
+        if (size_ > prefix_size)
+            seed = mix(seed, std::hash<std::string_view>{}(
+                                 std::string_view(rest(), size_ - prefix_size)));
+
+        return seed;
+    }
+};
+
+static_assert(sizeof(Short_String) == 32, "Short_String should fill half a cache line");
+
+}; // namespace RB
+
+template <>
+struct std::hash<RB::Short_String>
+{
+    size_t operator()(const RB::Short_String &key) const { return key.hash(); }
+};
+
+#endif // SHORT_STRING_H
@@ -0,0 +1,154 @@
+#ifndef SIZED_LINKS_H
+#define SIZED_LINKS_H
+
+#include <stddef.h> // for size_t, ptrdiff_t
+
+#include <iterator> // for bidirectional_iterator_tag
+
+namespace RB
+{
+
+namespace detail
+{
+
+/* Navigation shared by the binary search trees whose nodes hold `value`,
+ * a subtree `size` and `left`, `right` and `parent` links (Splay::Tree,
+ * Treap::Tree): in-order stepping, rotations that keep the sizes right and
+ * the bidirectional iterator. The trees differ only in how they restore
+ * their shape, so that stays with them. */
+template <typename KeyT, typename Node>
+struct Sized_Links
+{
+    static size_t size_of(const Node* node) { return node ? node->size : 0; }
+
+    static void update_size(Node* node)
+    {
+        node->size = size_of(node->left) + size_of(node->right) + 1;
+    }
+
+    static Node* sub_begin(Node* node)
+    {
+        while (node && node->left)
+            node = node->left;
+        return node;
+    }
+
+    static Node* sub_end(Node* node)
+    {
+        while (node && node->right)
+            node = node->right;
+        return node;
+    }
+
+    static Node* next(Node* node)
+    {
+        if (node->right)
+            return sub_begin(node->right);
+
+        while (node->parent && node == node->parent->right)
+            node = node->parent;
+
+        return node->parent;
+    }
+
+    static Node* prev(Node* node)
+    {
+        if (node->left)
+            return sub_end(node->left);
+
+        while (node->parent && node == node->parent->left)
+            node = node->parent;
+
+        return node->parent;
+    }
+
+    /* Lifts `node` above its parent; `root` follows if the parent was it. */
+    static void rotate(Node* node, Node*& root)
+    {
+        Node* parent = node->parent;
+        Node* grandparent = parent->parent;
+
+        if (parent->left == node)
+        {
+            parent->left = node->right;
+            if (node->right)
+                node->right->parent = parent;
+            node->right = parent;
+        }
+        else
+        {
+            parent->right = node->left;
+            if (node->left)
+                node->left->parent = parent;
+            node->left = parent;
+        }
+
+        parent->parent = node;
+        node->parent = grandparent;
+
+        if (grandparent == nullptr)
+            root = node;
+        else if (grandparent->left == parent)
+            grandparent->left = node;
+        else
+            grandparent->right = node;
+
+        node->size = parent->size;
+        update_size(parent);
+    }
+
+    class iterator
+    {
+      public:
+        using value_type = KeyT;
+        using difference_type = std::ptrdiff_t;
+        using reference = const KeyT &;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using pointer = const KeyT*;
+
+      private:
+        Node* node_;
+
+      public:
+        iterator(Node* node = nullptr)
+            : node_(node)
+        {}
+
+        const KeyT &operator*() const { return node_->value; }
+
+        iterator &operator++()
+        {
+            node_ = next(node_);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            node_ = next(node_);
+            return tmp;
+        }
+
+        iterator &operator--()
+        {
+            node_ = prev(node_);
+            return *this;
+        }
+
+        iterator operator--(int)
+        {
+            iterator tmp(*this);
+            node_ = prev(node_);
+            return tmp;
+        }
+
+        bool operator==(const iterator &other) const { return node_ == other.node_; }
+        bool operator!=(const iterator &other) const { return node_ != other.node_; }
+    };
+};
+
+}; // namespace detail
+
+}; // namespace RB
+
+#endif // SIZED_LINKS_H
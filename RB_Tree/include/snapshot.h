@@ -0,0 +1,210 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <fcntl.h>    // for open, O_RDONLY
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uint64_t, uint32_t
+#include <sys/mman.h> // for mmap, munmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for close
+
+#include <cstring>     // for memcmp, memcpy
+#include <stdexcept>   // for runtime_error
+#include <string>      // for string, to_string
+#include <type_traits> // for is_same_v
+
+namespace RB
+{
+
+namespace snapshot
+{
+
+/* On-disk layout: Header followed by `count` keys in ascending order, stored
+ * as raw native-endian bytes. The checksum covers the key bytes only. */
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t key_type;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t checksum;
+};
+
+static constexpr char magic[8] = {'R', 'B', 'S', 'N', 'A', 'P', '\0', '\0'};
+static constexpr uint32_t version = 2;
+
+/* Tags the key type of a file, so that keys of the same width but another
+ * type, say int64 and double, are not read back as each other. Also used by
+ * the write-ahead log and command files. */
+enum class Key_Type : uint32_t
+{
+    other = 0,
+    int32 = 1,
+    int64 = 2,
+    float64 = 3
+};
+
+template <typename KeyT>
+constexpr Key_Type key_type_of()
+{
+    if constexpr (std::is_same_v<KeyT, int32_t>)
+        return Key_Type::int32;
+    else if constexpr (std::is_same_v<KeyT, int64_t>)
+        return Key_Type::int64;
+    else if constexpr (std::is_same_v<KeyT, double>)
+        return Key_Type::float64;
+    else
+        return Key_Type::other;
+}
+
+/* Name as accepted by --key. */
+inline std::string key_type_name(uint32_t key_type)
+{
+    switch (static_cast<Key_Type>(key_type))
+    {
+        case Key_Type::int32:
+            return "int32";
+        case Key_Type::int64:
+            return "int64";
+        case Key_Type::float64:
+            return "double";
+        case Key_Type::other:
+        default:
+            return "unknown (" + std::to_string(key_type) + ")";
+    }
+}
+
+/* Throws unless a file tagged `key_type` holds keys of type KeyT. */
+template <typename KeyT>
+void check_key_type(uint32_t key_type, const std::string& path)
+{
+    if (key_type == static_cast<uint32_t>(key_type_of<KeyT>()))
+        return;
+
+    if (static_cast<Key_Type>(key_type) == Key_Type::other ||
+        key_type_of<KeyT>() == Key_Type::other)
+        throw std::runtime_error(path + ": key type mismatch");
+
+    throw std::runtime_error(path + ": holds " + key_type_name(key_type) +
+                             " keys, run with --key " + key_type_name(key_type));
+}
+
+/* FNV-1a, fed incrementally so keys can be hashed while they are written. */
+class Checksum
+{
+  private:
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+
+  public:
+    void update(const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+        for (size_t id = 0; id < size; ++id)
+        {
+            hash_ ^= bytes[id];
+            hash_ *= 0x100000001b3ULL;
+        }
+    }
+
+    uint64_t value() const { return hash_; }
+};
+
+/* Read-only memory mapping of a whole file. */
+class Mapped_File
+{
+  private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+
+  public:
+    explicit Mapped_File(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Can't open " + path);
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Can't stat " + path);
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+
+        if (size_ != 0)
+        {
+            data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data_ == MAP_FAILED)
+            {
+                data_ = nullptr;
+                ::close(fd);
+                throw std::runtime_error("Can't mmap " + path);
+            }
+        }
+
+        ::close(fd);
+    }
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator=(const Mapped_File&) = delete;
+
+    ~Mapped_File()
+    {
+        if (data_)
+            ::munmap(data_, size_);
+    }
+
+    const char* data() const { return static_cast<const char*>(data_); }
+    size_t size() const { return size_; }
+};
+
+/* Validates the header of a mapped snapshot and returns a pointer to its
+ * sorted keys. */
+template <typename KeyT>
+const KeyT* keys(const Mapped_File& file, const std::string& path,
+                 size_t& count)
+{
+    Header header{};
+
+    if (file.size() < sizeof(Header))
+        throw std::runtime_error(path + ": truncated snapshot header");
+
+    std::memcpy(&header, file.data(), sizeof(Header));
+
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+        throw std::runtime_error(path + ": not a tree snapshot");
+
+    if (header.version != version)
+        throw std::runtime_error(path + ": unsupported snapshot version " +
+                                 std::to_string(header.version));
+
+    check_key_type<KeyT>(header.key_type, path);
+
+    if (header.key_size != sizeof(KeyT))
+        throw std::runtime_error(path + ": key size mismatch");
+
+    if (header.count > (file.size() - sizeof(Header)) / sizeof(KeyT) ||
+        file.size() != sizeof(Header) + header.count * sizeof(KeyT))
+        throw std::runtime_error(path + ": snapshot size mismatch");
+
+    count = static_cast<size_t>(header.count);
+    const char* payload = file.data() + sizeof(Header);
+
+    Checksum checksum;
+    checksum.update(payload, count * sizeof(KeyT));
+
+    if (checksum.value() != header.checksum)
+        throw std::runtime_error(path + ": snapshot checksum mismatch");
+
+    return reinterpret_cast<const KeyT*>(payload);
+}
+
+}; // namespace snapshot
+
+}; // namespace RB
+
+#endif // SNAPSHOT_H
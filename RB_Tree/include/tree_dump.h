@@ -0,0 +1,155 @@
+#ifndef TREE_DUMP_H
+#define TREE_DUMP_H
+
+#include <stddef.h> // for size_t
+
+#include <charconv>    // for to_chars
+#include <cmath>       // for log2
+#include <cstring>     // for memcpy
+#include <limits>      // for numeric_limits
+#include <optional>    // for optional
+#include <ostream>     // for ostream
+#include <sstream>     // for ostringstream
+#include <string_view> // for string_view
+#include <type_traits> // for is_arithmetic_v
+#include <vector>      // for vector
+
+namespace RB
+{
+
+/* What Tree::dump() draws. Nodes deeper than max_depth, subtrees outside
+ * the focus range and all but every sample_every-th node of a level are
+ * drawn as one box with their key count instead of being expanded, so the
+ * output stays renderable whatever the tree size. */
+template <typename KeyT>
+struct Dump_Options
+{
+    size_t max_depth = std::numeric_limits<size_t>::max();
+    size_t sample_every = 1;
+
+    /* Only subtrees that may hold keys in [focus_from, focus_to] are
+     * expanded; an unset bound is open. */
+    std::optional<KeyT> focus_from;
+    std::optional<KeyT> focus_to;
+};
+
+/* Shape of a tree, gathered in one pass without drawing it. */
+struct Shape_Stats
+{
+    size_t nodes = 0;
+    size_t red = 0;
+    size_t height = 0;         // nodes on the longest root-to-leaf path
+    size_t min_leaf_depth = 0; // depth of the shallowest node missing a child
+    size_t black_height = 0;   // black nodes on the leftmost path
+    double average_depth = 0;
+    std::vector<size_t> level_counts;
+
+    /* Height over the least height a tree with as many nodes can have: 1
+     * for a perfectly balanced tree, under 2 for a red-black tree. */
+    double height_ratio() const
+    {
+        return nodes == 0 ? 1
+                          : static_cast<double>(height) /
+                                std::ceil(std::log2(static_cast<double>(nodes) + 1));
+    }
+};
+
+inline std::ostream &write_json(std::ostream &out, const Shape_Stats &stats)
+{
+    out << "{\"nodes\": " << stats.nodes << ", \"red\": " << stats.red
+        << ", \"height\": " << stats.height << ", \"min_leaf_depth\": "
+        << stats.min_leaf_depth << ", \"black_height\": " << stats.black_height
+        << ", \"average_depth\": " << stats.average_depth
+        << ", \"height_ratio\": " << stats.height_ratio() << ", \"level_counts\": [";
+
+    for (size_t level = 0; level < stats.level_counts.size(); ++level)
+        out << (level == 0 ? "" : ", ") << stats.level_counts[level];
+
+    return out << "]}";
+}
+
+namespace detail
+{
+
+/* Formats into a local buffer and hands the stream large chunks; numbers
+ * go through to_chars rather than the stream's locale-aware formatting. */
+class Dump_Writer
+{
+  private:
+    static constexpr size_t buffer_size_ = size_t{1} << 16;
+    static constexpr size_t max_number_ = 64; // longest to_chars output
+
+    std::ostream &out_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+
+    void reserve(size_t bytes)
+    {
+        if (buffer_size_ - used_ < bytes)
+            flush();
+    }
+
+  public:
+    explicit Dump_Writer(std::ostream &out)
+        : out_(out)
+        , buffer_(buffer_size_)
+    {}
+
+    Dump_Writer(const Dump_Writer &) = delete;
+    Dump_Writer &operator=(const Dump_Writer &) = delete;
+
+    ~Dump_Writer() { flush(); }
+
+    void flush()
+    {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+
+    Dump_Writer &operator<<(std::string_view text)
+    {
+        if (text.size() > buffer_size_)
+        {
+            flush();
+            out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return *this;
+        }
+
+        reserve(text.size());
+        std::memcpy(buffer_.data() + used_, text.data(), text.size());
+        used_ += text.size();
+
+        return *this;
+    }
+
+    Dump_Writer &operator<<(const char *text) { return *this << std::string_view(text); }
+
+    Dump_Writer &operator<<(char symbol) { return *this << std::string_view(&symbol, 1); }
+
+    template <typename Value>
+    Dump_Writer &operator<<(const Value &value)
+    {
+        if constexpr (std::is_arithmetic_v<Value>)
+        {
+            reserve(max_number_);
+
+            char* first = buffer_.data() + used_;
+            used_ += static_cast<size_t>(
+                std::to_chars(first, first + max_number_, value).ptr - first);
+
+            return *this;
+        }
+        else
+        {
+            std::ostringstream text;
+            text << value;
+            return *this << std::string_view(text.str());
+        }
+    }
+};
+
+}; // namespace detail
+
+}; // namespace RB
+
+#endif // TREE_DUMP_H
@@ -0,0 +1,275 @@
+#ifndef RANGE_TREE_H
+#define RANGE_TREE_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t
+
+#include <algorithm>  // for sort, lower_bound, upper_bound, partition_point
+#include <functional> // for less
+#include <numeric>    // for iota
+#include <utility>    // for move
+#include <vector>     // for vector
+
+namespace Range
+{
+
+template <typename KeyT>
+struct Point
+{
+    KeyT x{};
+    KeyT y{};
+};
+
+/* Static 2D range tree over a batch of points, answering how many points
+ * lie in [x1, x2] x [y1, y2] in O(log n).
+ *
+ * The primary tree splits the points sorted by x in halves. Instead of a y
+ * array per node it keeps fractional cascading counts: for every level and
+ * position, how many points of the node prefix went to the left child. A
+ * query binary-searches y1 and y2 once among all points and then carries the
+ * two positions down the tree in O(1) per node. Memory is n keys plus
+ * n log n 32-bit counts. Points form a multiset. */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Static_Tree
+{
+  public:
+    using point = Point<KeyT>;
+
+  private:
+    std::vector<point> points_; // by x, then y
+    std::vector<KeyT> ys_;      // all y in ascending order
+    std::vector<std::vector<uint32_t>> went_left_;
+    Compare cmp_;
+
+    /* Splits every node of level `depth` below [lo, hi): the ranks of each
+     * node, ordered by y, are stably partitioned into its halves. */
+    void split_level(size_t level, size_t depth, size_t lo, size_t hi,
+                     const std::vector<uint32_t> &order, std::vector<uint32_t> &next)
+    {
+        if (hi - lo < 2)
+        {
+            for (size_t pos = lo; pos < hi; ++pos)
+            {
+                went_left_[level][pos + 1] = went_left_[level][pos];
+                next[pos] = order[pos];
+            }
+            return;
+        }
+
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (depth != 0)
+        {
+            split_level(level, depth - 1, lo, mid, order, next);
+            split_level(level, depth - 1, mid, hi, order, next);
+            return;
+        }
+
+        std::vector<uint32_t> &counts = went_left_[level];
+        size_t left = lo;
+        size_t right = mid;
+
+        for (size_t pos = lo; pos < hi; ++pos)
+        {
+            bool goes_left = order[pos] < mid;
+
+            counts[pos + 1] = counts[pos] + (goes_left ? 1 : 0);
+            next[goes_left ? left++ : right++] = order[pos];
+        }
+    }
+
+    size_t count_node(size_t level, size_t lo, size_t hi, size_t x_lo, size_t x_hi,
+                      size_t below, size_t upto) const
+    {
+        if (below == upto || hi <= x_lo || x_hi <= lo)
+            return 0;
+
+        if (x_lo <= lo && hi <= x_hi)
+            return upto - below;
+
+        const std::vector<uint32_t> &counts = went_left_[level];
+        size_t mid = lo + (hi - lo) / 2;
+
+        size_t left_below = counts[lo + below] - counts[lo];
+        size_t left_upto = counts[lo + upto] - counts[lo];
+
+        return count_node(level + 1, lo, mid, x_lo, x_hi, left_below, left_upto) +
+               count_node(level + 1, mid, hi, x_lo, x_hi, below - left_below,
+                          upto - left_upto);
+    }
+
+  public:
+    Static_Tree() = default;
+
+    explicit Static_Tree(std::vector<point> points)
+        : points_(std::move(points))
+    {
+        std::sort(points_.begin(), points_.end(),
+                  [this](const point &lhs, const point &rhs)
+                  {
+                      return cmp_(lhs.x, rhs.x) ||
+                             (!cmp_(rhs.x, lhs.x) && cmp_(lhs.y, rhs.y));
+                  });
+
+        size_t count = points_.size();
+
+        /* Ranks in x order, sorted by y: the root of the cascade. */
+        std::vector<uint32_t> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(),
+                         [this](uint32_t lhs, uint32_t rhs)
+                         { return cmp_(points_[lhs].y, points_[rhs].y); });
+
+        ys_.reserve(count);
+        for (uint32_t rank : order)
+            ys_.push_back(points_[rank].y);
+
+        std::vector<uint32_t> next(count);
+
+        for (size_t span = count, level = 0; span > 1; span = (span + 1) / 2, ++level)
+        {
+            went_left_.emplace_back(count + 1, 0);
+            split_level(level, level, 0, count, order, next);
+            order.swap(next);
+        }
+    }
+
+    /* Number of points with x in [x1, x2] and y in [y1, y2]. */
+    size_t count(const KeyT &x1, const KeyT &y1, const KeyT &x2, const KeyT &y2) const
+    {
+        if (points_.empty() || cmp_(x2, x1) || cmp_(y2, y1))
+            return 0;
+
+        auto x_first = std::partition_point(points_.begin(), points_.end(),
+                                            [&](const point &p) { return cmp_(p.x, x1); });
+        auto x_last = std::partition_point(x_first, points_.end(),
+                                           [&](const point &p) { return !cmp_(x2, p.x); });
+
+        auto y_first = std::lower_bound(ys_.begin(), ys_.end(), y1, cmp_);
+        auto y_last = std::upper_bound(y_first, ys_.end(), y2, cmp_);
+
+        return count_node(0, 0, points_.size(),
+                          static_cast<size_t>(x_first - points_.begin()),
+                          static_cast<size_t>(x_last - points_.begin()),
+                          static_cast<size_t>(y_first - ys_.begin()),
+                          static_cast<size_t>(y_last - ys_.begin()));
+    }
+
+    const std::vector<point> &points() const { return points_; }
+
+    size_t size() const { return points_.size(); }
+    bool empty() const { return points_.empty(); }
+};
+
+/* Log-structured (Bentley-Saxe) range tree for online inserts. New points
+ * gather in a small buffer; a full buffer is rebuilt into level i, which
+ * holds buffer_size * 2^i points, merging the occupied levels below it like
+ * a binary counter. Inserts cost O(log^2 n) amortized, queries O(log^2 n).
+ *
+ * Queries first fold everything into one static base tree once the points
+ * added since the last fold make up half of the total, so a batch of inserts
+ * followed by queries is answered by a single tree in O(log n), while the
+ * folding work stays O(log n) amortized per insert. */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Dynamic_Tree
+{
+  public:
+    using point = Point<KeyT>;
+    using static_tree = Static_Tree<KeyT, Compare>;
+
+  private:
+    static constexpr size_t buffer_size_ = 64;
+
+    static_tree base_;
+    std::vector<static_tree> levels_;
+    std::vector<point> buffer_;
+    size_t unfolded_ = 0; // points outside base_
+    Compare cmp_;
+
+    void carry()
+    {
+        std::vector<point> merged = std::move(buffer_);
+        buffer_.clear();
+
+        size_t level = 0;
+
+        for (; level < levels_.size() && !levels_[level].empty(); ++level)
+        {
+            const std::vector<point> &points = levels_[level].points();
+            merged.insert(merged.end(), points.begin(), points.end());
+            levels_[level] = static_tree{};
+        }
+
+        if (level == levels_.size())
+            levels_.emplace_back();
+
+        levels_[level] = static_tree(std::move(merged));
+    }
+
+  public:
+    void insert(const KeyT &x, const KeyT &y)
+    {
+        buffer_.push_back({x, y});
+        ++unfolded_;
+
+        if (buffer_.size() == buffer_size_)
+            carry();
+    }
+
+    /* Rebuilds all points into the base tree. */
+    void fold()
+    {
+        if (unfolded_ == 0)
+            return;
+
+        std::vector<point> merged = base_.points();
+        merged.reserve(size());
+
+        for (static_tree &level : levels_)
+        {
+            merged.insert(merged.end(), level.points().begin(), level.points().end());
+            level = static_tree{};
+        }
+
+        merged.insert(merged.end(), buffer_.begin(), buffer_.end());
+        buffer_.clear();
+
+        base_ = static_tree(std::move(merged));
+        unfolded_ = 0;
+    }
+
+    size_t count(const KeyT &x1, const KeyT &y1, const KeyT &x2, const KeyT &y2)
+    {
+        if (2 * unfolded_ >= size() && unfolded_ > buffer_size_)
+            fold();
+
+        size_t result = base_.count(x1, y1, x2, y2);
+
+        for (const static_tree &level : levels_)
+            result += level.count(x1, y1, x2, y2);
+
+        for (const point &p : buffer_)
+            if (!cmp_(p.x, x1) && !cmp_(x2, p.x) && !cmp_(p.y, y1) && !cmp_(y2, p.y))
+                ++result;
+
+        return result;
+    }
+
+    size_t size() const { return base_.size() + unfolded_; }
+
+    /* Static trees a query has to visit. */
+    size_t trees() const
+    {
+        size_t result = base_.empty() ? 0 : 1;
+
+        for (const static_tree &level : levels_)
+            if (!level.empty())
+                ++result;
+
+        return result;
+    }
+};
+
+}; // namespace Range
+
+#endif // RANGE_TREE_H
@@ -0,0 +1,99 @@
+#ifndef SORTED_ARRAY_H
+#define SORTED_ARRAY_H
+
+#include <stddef.h> // for size_t
+
+#include <algorithm>  // for lower_bound, upper_bound
+#include <functional> // for less
+#include <iterator>   // for distance
+#include <vector>     // for vector
+
+namespace Sorted
+{
+
+/* Set of keys kept in one contiguous sorted vector: range counts are two
+ * binary searches, inserts shift the tail and cost O(n). */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Array
+{
+  private:
+    std::vector<KeyT> data_;
+    Compare cmp_;
+
+  public:
+    using iterator = typename std::vector<KeyT>::const_iterator;
+
+    iterator begin() const { return data_.begin(); }
+    iterator end() const { return data_.end(); }
+
+    size_t size() const { return data_.size(); }
+
+    void insert(const KeyT &value)
+    {
+        auto position = std::lower_bound(data_.begin(), data_.end(), value, cmp_);
+
+        if (position == data_.end() || cmp_(value, *position))
+            data_.insert(position, value);
+    }
+
+    size_t erase(const KeyT &value)
+    {
+        auto position = std::lower_bound(data_.begin(), data_.end(), value, cmp_);
+
+        if (position == data_.end() || cmp_(value, *position))
+            return 0;
+
+        data_.erase(position);
+        return 1;
+    }
+
+    iterator lower_bound(const KeyT &key) const
+    {
+        return std::lower_bound(data_.begin(), data_.end(), key, cmp_);
+    }
+
+    iterator upper_bound(const KeyT &key) const
+    {
+        return std::upper_bound(data_.begin(), data_.end(), key, cmp_);
+    }
+
+    size_t range_count(const KeyT &left_b, const KeyT &right_b) const
+    {
+        if (cmp_(right_b, left_b))
+            return 0;
+
+        return static_cast<size_t>(
+            std::distance(lower_bound(left_b), upper_bound(right_b)));
+    }
+
+    /* Number of keys ordered before `key`. */
+    size_t rank(const KeyT &key) const
+    {
+        return static_cast<size_t>(lower_bound(key) - data_.begin());
+    }
+
+    /* The key with `index` smaller keys, or end(). */
+    iterator select(size_t index) const
+    {
+        return index < data_.size()
+                   ? data_.begin() + static_cast<std::ptrdiff_t>(index)
+                   : data_.end();
+    }
+
+    /* Replaces the contents with a strictly increasing range. */
+    template <typename InputIt>
+    void assign_sorted(InputIt first, InputIt last)
+    {
+        data_.assign(first, last);
+    }
+
+    void clear()
+    {
+        data_.clear();
+        data_.shrink_to_fit();
+    }
+};
+
+}; // namespace Sorted
+
+#endif // SORTED_ARRAY_H
@@ -0,0 +1,310 @@
+#ifndef SPLAY_TREE_H
+#define SPLAY_TREE_H
+
+#include <stddef.h> // for size_t
+
+#include <functional> // for less
+#include <utility>    // for swap
+
+#include "node_pool.h"   // for Node_Pool
+#include "sized_links.h" // for Sized_Links
+
+namespace Splay
+{
+
+/* Self-adjusting binary search tree (Sleator, Tarjan): every access splays
+ * the touched node to the root, so keys and ranges queried often stay a few
+ * steps from it. All operations are O(log n) amortized, and a sequence of
+ * accesses costs O(n log n) less the entropy of the access distribution,
+ * which is what skewed workloads gain over a balanced tree.
+ *
+ * Nodes keep subtree sizes for O(log n) ranks and range counts. Lookups
+ * restructure the tree, so they are not const. */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Tree
+{
+  private:
+    struct Node
+    {
+        KeyT value{};
+        size_t size = 1;
+
+        Node* left{};
+        Node* right{};
+        Node* parent{};
+
+        Node() = default;
+
+        Node(const KeyT &_value, Node* _parent)
+            : value(_value)
+            , parent(_parent)
+        {}
+    };
+
+    Node* root_ = nullptr;
+    RB::detail::Node_Pool<Node> data_;
+    Compare cmp_;
+
+    using Links = RB::detail::Sized_Links<KeyT, Node>;
+
+    void splay(Node* node)
+    {
+        while (node->parent)
+        {
+            Node* parent = node->parent;
+            Node* grandparent = parent->parent;
+
+            if (grandparent)
+            {
+                bool zig_zig = (grandparent->left == parent) == (parent->left == node);
+                Links::rotate(zig_zig ? parent : node, root_);
+            }
+
+            Links::rotate(node, root_);
+        }
+    }
+
+    /* Descends towards `key` and splays the node it ends at. Returns the
+     * node holding `key`, or nullptr. */
+    Node* find(const KeyT &key)
+    {
+        Node* cur_node = root_;
+        Node* last = nullptr;
+
+        while (cur_node)
+        {
+            last = cur_node;
+
+            if (cmp_(key, cur_node->value))
+                cur_node = cur_node->left;
+            else if (cmp_(cur_node->value, key))
+                cur_node = cur_node->right;
+            else
+                break;
+        }
+
+        if (last)
+            splay(last);
+
+        return cur_node;
+    }
+
+    /* First node not before `key` (or after it, if `strict`), splaying the
+     * last node on the search path. */
+    Node* bound(const KeyT &key, bool strict)
+    {
+        Node* cur_node = root_;
+        Node* last = nullptr;
+        Node* answer = nullptr;
+
+        while (cur_node)
+        {
+            last = cur_node;
+
+            if (strict ? cmp_(key, cur_node->value) : !cmp_(cur_node->value, key))
+            {
+                answer = cur_node;
+                cur_node = cur_node->left;
+            }
+            else
+                cur_node = cur_node->right;
+        }
+
+        if (last)
+            splay(last);
+
+        return answer;
+    }
+
+    /* Number of keys before `key` (not after it, if `inclusive`). */
+    size_t count_before(const KeyT &key, bool inclusive)
+    {
+        Node* cur_node = root_;
+        Node* last = nullptr;
+        size_t result = 0;
+
+        while (cur_node)
+        {
+            last = cur_node;
+
+            if (inclusive ? !cmp_(key, cur_node->value) : cmp_(cur_node->value, key))
+            {
+                result += Links::size_of(cur_node->left) + 1;
+                cur_node = cur_node->right;
+            }
+            else
+                cur_node = cur_node->left;
+        }
+
+        if (last)
+            splay(last);
+
+        return result;
+    }
+
+    long check_subtree(const Node* node, const Node* parent) const
+    {
+        if (node == nullptr)
+            return 0;
+
+        if (node->parent != parent ||
+            (node->left && !cmp_(node->left->value, node->value)) ||
+            (node->right && !cmp_(node->value, node->right->value)))
+            return -1;
+
+        long left_size = check_subtree(node->left, node);
+        long right_size = check_subtree(node->right, node);
+
+        if (left_size < 0 || right_size < 0 ||
+            node->size != static_cast<size_t>(left_size + right_size + 1))
+            return -1;
+
+        return left_size + right_size + 1;
+    }
+
+  public:
+    using iterator = typename Links::iterator;
+
+    Tree() = default;
+
+    Tree(const Tree &other)
+    {
+        for (Node* node = Links::sub_begin(other.root_); node; node = Links::next(node))
+            insert(node->value);
+    }
+
+    Tree(Tree &&other) noexcept { swap(other); }
+
+    Tree &operator=(Tree other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(Tree &other) noexcept
+    {
+        std::swap(root_, other.root_);
+        data_.swap(other.data_);
+    }
+
+    iterator begin() const { return iterator(Links::sub_begin(root_)); }
+    iterator end() const { return iterator(nullptr); }
+
+    size_t size() const { return Links::size_of(root_); }
+
+    void insert(const KeyT &value)
+    {
+        Node* cur_node = root_;
+        Node* parent = nullptr;
+
+        while (cur_node)
+        {
+            parent = cur_node;
+
+            if (cmp_(value, cur_node->value))
+                cur_node = cur_node->left;
+            else if (cmp_(cur_node->value, value))
+                cur_node = cur_node->right;
+            else
+            {
+                splay(cur_node);
+                return;
+            }
+        }
+
+        Node* inserted = data_.make(value, parent);
+
+        if (parent == nullptr)
+            root_ = inserted;
+        else if (cmp_(value, parent->value))
+            parent->left = inserted;
+        else
+            parent->right = inserted;
+
+        for (Node* up = parent; up; up = up->parent)
+            ++up->size;
+
+        splay(inserted);
+    }
+
+    size_t erase(const KeyT &key)
+    {
+        Node* node = find(key);
+
+        if (node == nullptr)
+            return 0;
+
+        /* find() left the node at the root: join its two subtrees. */
+        Node* left = node->left;
+        Node* right = node->right;
+
+        if (left == nullptr)
+        {
+            root_ = right;
+            if (right)
+                right->parent = nullptr;
+        }
+        else
+        {
+            left->parent = nullptr;
+            root_ = left;
+
+            Node* max = Links::sub_end(left);
+            splay(max);
+
+            max->right = right;
+            if (right)
+                right->parent = max;
+            Links::update_size(max);
+        }
+
+        data_.release(node);
+        return 1;
+    }
+
+    iterator lower_bound(const KeyT &key) { return iterator(bound(key, false)); }
+    iterator upper_bound(const KeyT &key) { return iterator(bound(key, true)); }
+
+    size_t rank(const KeyT &key) { return count_before(key, false); }
+
+    /* The key with `index` smaller keys, or end(). */
+    iterator select(size_t index)
+    {
+        Node* cur_node = root_;
+
+        while (cur_node)
+        {
+            size_t left_size = Links::size_of(cur_node->left);
+
+            if (index < left_size)
+                cur_node = cur_node->left;
+            else if (index == left_size)
+            {
+                splay(cur_node);
+                return iterator(cur_node);
+            }
+            else
+            {
+                index -= left_size + 1;
+                cur_node = cur_node->right;
+            }
+        }
+
+        return end();
+    }
+
+    size_t range_count(const KeyT &left_b, const KeyT &right_b)
+    {
+        if (cmp_(right_b, left_b))
+            return 0;
+
+        return count_before(right_b, true) - count_before(left_b, false);
+    }
+
+    /* Checks ordering, parent links and subtree sizes; for tests. */
+    bool verify() const { return check_subtree(root_, nullptr) >= 0; }
+};
+
+}; // namespace Splay
+
+#endif // SPLAY_TREE_H
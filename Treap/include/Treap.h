@@ -0,0 +1,280 @@
+#ifndef TREAP_H
+#define TREAP_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t
+
+#include <functional> // for less
+#include <utility>    // for swap
+
+#include "node_pool.h"   // for Node_Pool
+#include "sized_links.h" // for Sized_Links
+
+namespace Treap
+{
+
+/* Randomized search tree (Aragon, Seidel): a binary search tree by key and
+ * a max-heap by random priority, so its shape is that of a random insertion
+ * order: O(log n) expected depth without any balancing metadata beyond the
+ * priority. Lookups don't restructure the tree, unlike Splay::Tree, which
+ * keeps them cheap and const, but hot keys don't move up either.
+ *
+ * Nodes keep subtree sizes for O(log n) ranks and range counts. */
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Tree
+{
+  private:
+    struct Node
+    {
+        KeyT value{};
+        uint32_t priority = 0;
+        size_t size = 1;
+
+        Node* left{};
+        Node* right{};
+        Node* parent{};
+
+        Node() = default;
+
+        Node(const KeyT &_value, uint32_t _priority, Node* _parent)
+            : value(_value)
+            , priority(_priority)
+            , parent(_parent)
+        {}
+    };
+
+    Node* root_ = nullptr;
+    RB::detail::Node_Pool<Node> data_;
+    uint64_t random_state_ = 0x2545f4914f6cdd1dULL;
+    Compare cmp_;
+
+    using Links = RB::detail::Sized_Links<KeyT, Node>;
+
+    uint32_t random_priority()
+    {
+        random_state_ ^= random_state_ << 13;
+        random_state_ ^= random_state_ >> 7;
+        random_state_ ^= random_state_ << 17;
+
+        return static_cast<uint32_t>(random_state_ >> 32);
+    }
+
+    Node* find(const KeyT &key) const
+    {
+        Node* cur_node = root_;
+
+        while (cur_node)
+        {
+            if (cmp_(key, cur_node->value))
+                cur_node = cur_node->left;
+            else if (cmp_(cur_node->value, key))
+                cur_node = cur_node->right;
+            else
+                return cur_node;
+        }
+
+        return nullptr;
+    }
+
+    /* First node not before `key` (or after it, if `strict`). */
+    Node* bound(const KeyT &key, bool strict) const
+    {
+        Node* cur_node = root_;
+        Node* answer = nullptr;
+
+        while (cur_node)
+        {
+            if (strict ? cmp_(key, cur_node->value) : !cmp_(cur_node->value, key))
+            {
+                answer = cur_node;
+                cur_node = cur_node->left;
+            }
+            else
+                cur_node = cur_node->right;
+        }
+
+        return answer;
+    }
+
+    /* Number of keys before `key` (not after it, if `inclusive`). */
+    size_t count_before(const KeyT &key, bool inclusive) const
+    {
+        Node* cur_node = root_;
+        size_t result = 0;
+
+        while (cur_node)
+        {
+            if (inclusive ? !cmp_(key, cur_node->value) : cmp_(cur_node->value, key))
+            {
+                result += Links::size_of(cur_node->left) + 1;
+                cur_node = cur_node->right;
+            }
+            else
+                cur_node = cur_node->left;
+        }
+
+        return result;
+    }
+
+    long check_subtree(const Node* node, const Node* parent) const
+    {
+        if (node == nullptr)
+            return 0;
+
+        if (node->parent != parent || (parent && parent->priority < node->priority) ||
+            (node->left && !cmp_(node->left->value, node->value)) ||
+            (node->right && !cmp_(node->value, node->right->value)))
+            return -1;
+
+        long left_size = check_subtree(node->left, node);
+        long right_size = check_subtree(node->right, node);
+
+        if (left_size < 0 || right_size < 0 ||
+            node->size != static_cast<size_t>(left_size + right_size + 1))
+            return -1;
+
+        return left_size + right_size + 1;
+    }
+
+  public:
+    using iterator = typename Links::iterator;
+
+    Tree() = default;
+
+    Tree(const Tree &other)
+    {
+        for (Node* node = Links::sub_begin(other.root_); node; node = Links::next(node))
+            insert(node->value);
+    }
+
+    Tree(Tree &&other) noexcept { swap(other); }
+
+    Tree &operator=(Tree other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(Tree &other) noexcept
+    {
+        std::swap(root_, other.root_);
+        std::swap(random_state_, other.random_state_);
+        data_.swap(other.data_);
+    }
+
+    iterator begin() const { return iterator(Links::sub_begin(root_)); }
+    iterator end() const { return iterator(nullptr); }
+
+    size_t size() const { return Links::size_of(root_); }
+
+    void insert(const KeyT &value)
+    {
+        Node* cur_node = root_;
+        Node* parent = nullptr;
+
+        while (cur_node)
+        {
+            parent = cur_node;
+
+            if (cmp_(value, cur_node->value))
+                cur_node = cur_node->left;
+            else if (cmp_(cur_node->value, value))
+                cur_node = cur_node->right;
+            else
+                return;
+        }
+
+        Node* inserted = data_.make(value, random_priority(), parent);
+
+        if (parent == nullptr)
+            root_ = inserted;
+        else if (cmp_(value, parent->value))
+            parent->left = inserted;
+        else
+            parent->right = inserted;
+
+        for (Node* up = parent; up; up = up->parent)
+            ++up->size;
+
+        while (inserted->parent && inserted->parent->priority < inserted->priority)
+            Links::rotate(inserted, root_);
+    }
+
+    size_t erase(const KeyT &key)
+    {
+        Node* node = find(key);
+
+        if (node == nullptr)
+            return 0;
+
+        /* Sink the node below its higher-priority child until it is a leaf
+         * or has a single child to splice in. */
+        while (node->left && node->right)
+        {
+            Node* higher = node->left->priority > node->right->priority ? node->left : node->right;
+            Links::rotate(higher, root_);
+        }
+
+        Node* child = node->left ? node->left : node->right;
+        Node* parent = node->parent;
+
+        if (child)
+            child->parent = parent;
+
+        if (parent == nullptr)
+            root_ = child;
+        else if (parent->left == node)
+            parent->left = child;
+        else
+            parent->right = child;
+
+        for (Node* up = parent; up; up = up->parent)
+            --up->size;
+
+        data_.release(node);
+        return 1;
+    }
+
+    iterator lower_bound(const KeyT &key) const { return iterator(bound(key, false)); }
+    iterator upper_bound(const KeyT &key) const { return iterator(bound(key, true)); }
+
+    size_t rank(const KeyT &key) const { return count_before(key, false); }
+
+    /* The key with `index` smaller keys, or end(). */
+    iterator select(size_t index) const
+    {
+        Node* cur_node = root_;
+
+        while (cur_node)
+        {
+            size_t left_size = Links::size_of(cur_node->left);
+
+            if (index < left_size)
+                cur_node = cur_node->left;
+            else if (index == left_size)
+                return iterator(cur_node);
+            else
+            {
+                index -= left_size + 1;
+                cur_node = cur_node->right;
+            }
+        }
+
+        return end();
+    }
+
+    size_t range_count(const KeyT &left_b, const KeyT &right_b) const
+    {
+        if (cmp_(right_b, left_b))
+            return 0;
+
+        return count_before(right_b, true) - count_before(left_b, false);
+    }
+
+    /* Checks ordering, heap order, parent links and subtree sizes; for tests. */
+    bool verify() const { return check_subtree(root_, nullptr) >= 0; }
+};
+
+}; // namespace Treap
+
+#endif // TREAP_H
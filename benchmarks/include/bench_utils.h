@@ -0,0 +1,88 @@
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <chrono>   // for steady_clock, duration
+#include <cmath>    // for pow
+#include <cstdlib>  // for strtoull
+#include <iomanip>  // for setw, setprecision
+#include <iostream> // for cout
+#include <random>   // for mt19937_64
+#include <string>   // for string
+#include <vector>   // for vector
+
+namespace bench
+{
+
+class Stopwatch
+{
+  private:
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+  public:
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start_)
+            .count();
+    }
+};
+
+/* Keeps the optimizer from dropping a computed value. */
+template <typename T>
+inline void keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* First positional argument, if any, overrides the default problem size. */
+inline size_t size_arg(int argc, char **argv, size_t fallback)
+{
+    return argc > 1 ? std::strtoull(argv[1], nullptr, 10) : fallback;
+}
+
+inline std::vector<int> uniform_keys(size_t count, int range, uint64_t seed = 1)
+{
+    std::mt19937_64 generator(seed);
+    std::uniform_int_distribution<int> keys(0, range - 1);
+
+    std::vector<int> result(count);
+    for (auto &key : result)
+        key = keys(generator);
+
+    return result;
+}
+
+/* Zipf-like keys: rank r in [1, range] is drawn with weight 1 / r^skew and
+ * mapped through a fixed permutation so hot keys are spread out. */
+inline std::vector<int> zipf_keys(size_t count, int range, double skew,
+                                  uint64_t seed = 1)
+{
+    std::vector<double> weights(static_cast<size_t>(range));
+    for (size_t rank = 0; rank < weights.size(); ++rank)
+        weights[rank] = 1.0 / std::pow(static_cast<double>(rank + 1), skew);
+
+    std::mt19937_64 generator(seed);
+    std::discrete_distribution<int> ranks(weights.begin(), weights.end());
+
+    std::vector<int> result(count);
+    for (auto &key : result)
+        key = static_cast<int>((static_cast<uint64_t>(ranks(generator)) *
+                                2654435761ULL) % static_cast<uint64_t>(range));
+
+    return result;
+}
+
+inline void report(const std::string &name, size_t operations, double seconds)
+{
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(14)
+              << std::fixed << std::setprecision(0)
+              << static_cast<double>(operations) / seconds << " ops/s"
+              << std::setw(12) << std::setprecision(3) << seconds * 1000 << " ms\n";
+}
+
+}; // namespace bench
+
+#endif // BENCH_UTILS_H
@@ -0,0 +1,58 @@
+#include <stddef.h> // for size_t
+
+#include <iostream> // for cout
+#include <string>   // for string
+#include <vector>   // for vector
+
+#include "RB_Tree.h"     // for Tree
+#include "bench_utils.h" // for Stopwatch, report, keep, uniform_keys
+
+namespace
+{
+
+void measure(const std::string &name, RB::Tree<int> &tree, const std::vector<int> &bounds)
+{
+    std::cout << name << ": " << tree.size() << " keys in " << tree.bytes() / 1024
+              << " KiB\n";
+
+    long long sum = 0;
+    bench::Stopwatch scan;
+    for (int key : tree)
+        sum += key;
+    bench::report(name + " in-order scan", tree.size(), scan.seconds());
+    bench::keep(sum);
+
+    size_t total = 0;
+    bench::Stopwatch counts;
+    for (int left : bounds)
+        total += tree.range_count(left, left + (1 << 16));
+    bench::report(name + " range_count", bounds.size(), counts.seconds());
+    bench::keep(total);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 2000000);
+
+    std::vector<int> keys = bench::uniform_keys(count, 1 << 30, 1);
+    std::vector<int> bounds = bench::uniform_keys(1000000, 1 << 30, 2);
+
+    /* Insertion order scatters neighbours, and erasing a half leaves holes. */
+    RB::Tree<int> tree;
+    for (int key : keys)
+        tree.insert(key);
+    for (size_t id = 0; id < keys.size(); id += 2)
+        tree.erase(keys[id]);
+
+    measure("fragmented", tree, bounds);
+
+    bench::Stopwatch compaction;
+    tree.compact();
+    bench::report("compact()", tree.size(), compaction.seconds());
+
+    measure("compacted", tree, bounds);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stddef.h> // for size_t
+
+#include <algorithm> // for max
+#include <iostream>  // for cout
+#include <string>    // for string, to_string
+#include <thread>    // for thread
+
+#include "RB_Tree.h"     // for Tree
+#include "bench_utils.h" // for Stopwatch, report, keep, uniform_keys
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 10000000);
+
+    /* Random insert order scatters nodes over the pool like a live tree. */
+    RB::Tree<int> tree;
+    for (int key : bench::uniform_keys(count, 1 << 30, 2))
+        tree.insert(key);
+
+    std::cout << "--- copying a tree of " << tree.size() << " keys ---\n";
+
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned threads = 1; threads <= hardware; threads *= 2)
+    {
+        bench::Stopwatch copy;
+        RB::Tree<int> copied = tree.copy(threads);
+        bench::report("copy, " + std::to_string(threads) + " threads", copied.size(),
+                      copy.seconds());
+
+        /* The copy is laid out in key order, the source in insertion order. */
+        bench::Stopwatch scan_copy;
+        long sum = 0;
+        for (int key : copied)
+            sum += key;
+        bench::keep(sum);
+
+        if (threads == 1)
+        {
+            bench::Stopwatch scan_source;
+            for (int key : tree)
+                sum += key;
+            bench::keep(sum);
+
+            bench::report("scan source", tree.size(), scan_source.seconds());
+            bench::report("scan copy", copied.size(), scan_copy.seconds());
+        }
+    }
+
+    {
+        bench::Stopwatch clone;
+        RB::Tree<int> cloned = tree.clone();
+        bench::report("clone", 1, clone.seconds());
+
+        bench::Stopwatch first_write;
+        cloned.insert(-1);
+        bench::report("first insert into a clone", 1, first_write.seconds());
+
+        bench::Stopwatch writes;
+        for (int key = 0; key < 100000; ++key)
+            cloned.insert(-2 - key);
+        bench::report("later inserts into the clone", 100000, writes.seconds());
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <algorithm> // for max
+#include <iostream>  // for cout
+#include <string>    // for string, to_string
+#include <thread>    // for hardware_concurrency
+#include <vector>    // for vector
+
+#include "RB_Tree.h"     // for Tree
+#include "bench_utils.h" // for Stopwatch, report, uniform_keys
+#include "radix_sort.h"  // for sort_unique
+
+namespace
+{
+
+/* Inserts `bursts` runs of keys into a tree that already holds `base`. */
+void ingest(const std::vector<int> &base, const std::vector<std::vector<int>> &bursts,
+            unsigned threads)
+{
+    size_t total = 0;
+    for (const std::vector<int> &burst : bursts)
+        total += burst.size();
+
+    {
+        RB::Tree<int> tree;
+        tree.insert_sorted(base.begin(), base.end());
+
+        bench::Stopwatch inserts;
+        for (const std::vector<int> &burst : bursts)
+            for (int key : burst)
+                tree.insert(key);
+        bench::report("one insert per key", total, inserts.seconds());
+    }
+
+    for (unsigned count = 1; count <= threads; count *= 2)
+    {
+        RB::Tree<int> tree;
+        tree.insert_sorted(base.begin(), base.end());
+
+        double sorting = 0;
+        bench::Stopwatch ingest;
+        for (std::vector<int> burst : bursts)
+        {
+            bench::Stopwatch sort;
+            range_queries::sort_unique(burst, count);
+            sorting += sort.seconds();
+
+            tree.insert_sorted(burst.begin(), burst.end());
+        }
+
+        double seconds = ingest.seconds();
+        bench::report("bursts, " + std::to_string(count) + " threads", total, seconds);
+        bench::report("  of which sorting", total, sorting);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 4000000);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "--- " << count << " keys into an empty tree, one burst ---\n";
+    ingest({}, {bench::uniform_keys(count, 1 << 30, 1)}, threads);
+
+    std::vector<int> base = bench::uniform_keys(count, 1 << 30, 2);
+    range_queries::sort_unique(base, threads);
+
+    std::vector<std::vector<int>> bursts;
+    for (uint64_t seed = 3; seed < 13; ++seed)
+        bursts.push_back(bench::uniform_keys(count / 100, 1 << 30, seed));
+
+    std::cout << "--- 10 bursts of " << count / 100 << " keys into " << base.size()
+              << " keys ---\n";
+    ingest(base, bursts, threads);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stddef.h> // for size_t
+#include <stdint.h> // for int32_t, int64_t, uint64_t
+
+#include <algorithm> // for minmax
+#include <cstdio>    // for snprintf
+#include <iostream>  // for cout
+#include <random>    // for mt19937_64, uniform_int_distribution
+#include <string>    // for string
+#include <utility>   // for pair
+#include <vector>    // for vector
+
+#include "RB_Tree.h"      // for Tree
+#include "bench_utils.h"  // for Stopwatch, report, keep
+#include "short_string.h" // for Short_String
+
+namespace
+{
+
+template <typename Key>
+void measure(const std::string &name, const std::vector<Key> &keys,
+             const std::vector<std::pair<Key, Key>> &ranges)
+{
+    RB::Tree<Key> tree;
+
+    bench::Stopwatch inserts;
+    for (const Key &key : keys)
+        tree.insert(key);
+    bench::report(name + " insert", keys.size(), inserts.seconds());
+
+    size_t found = 0;
+    bench::Stopwatch lookups;
+    for (const auto &range : ranges)
+        found += tree.lower_bound(range.first) != tree.end();
+    bench::report(name + " lower_bound", ranges.size(), lookups.seconds());
+    bench::keep(found);
+
+    size_t total = 0;
+    bench::Stopwatch counts;
+    for (const auto &range : ranges)
+        total += tree.range_count(range.first, range.second);
+    bench::report(name + " range_count", ranges.size(), counts.seconds());
+    bench::keep(total);
+}
+
+/* Keys made from random 64-bit numbers, and ranges between two of them. */
+template <typename Key, typename Make>
+void run(const std::string &name, size_t count, size_t queries, Make make)
+{
+    std::mt19937_64 generator(1);
+    std::uniform_int_distribution<uint64_t> numbers;
+
+    std::vector<Key> keys;
+    keys.reserve(count);
+    for (size_t id = 0; id < count; ++id)
+        keys.push_back(make(numbers(generator)));
+
+    std::vector<std::pair<Key, Key>> ranges;
+    ranges.reserve(queries);
+    for (size_t id = 0; id < queries; ++id)
+    {
+        Key first = make(numbers(generator));
+        Key second = make(numbers(generator));
+        ranges.push_back(std::minmax(first, second));
+    }
+
+    measure(name, keys, ranges);
+}
+
+/* Lower-case words of 6 to 20 letters: most differ in the first bytes. */
+std::string word(uint64_t number)
+{
+    std::string text(6 + number % 15, 'a');
+    for (char &letter : text)
+    {
+        number = number * 6364136223846793005ULL + 1442695040888963407ULL;
+        letter = static_cast<char>('a' + (number >> 59) % 26);
+    }
+
+    return text;
+}
+
+/* "user:" and a zero-padded number: 15 bytes that share their first five,
+ * so many comparisons go past the cached prefix. */
+std::string user_id(uint64_t number)
+{
+    char text[16];
+    std::snprintf(text, sizeof(text), "user:%010llu",
+                  static_cast<unsigned long long>(number % 10000000000ULL));
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 1000000);
+    size_t queries = 1000000;
+
+    std::cout << "--- " << count << " random keys, " << queries << " probes ---\n";
+
+    run<int32_t>("int32", count, queries,
+                 [](uint64_t number) { return static_cast<int32_t>(number); });
+    run<int64_t>("int64", count, queries,
+                 [](uint64_t number) { return static_cast<int64_t>(number); });
+    run<double>("double", count, queries,
+                [](uint64_t number) { return static_cast<double>(number >> 11) * 0x1p-53; });
+
+    run<std::string>("std::string words", count, queries, word);
+    run<RB::Short_String>("Short_String words", count, queries,
+                          [](uint64_t number) { return RB::Short_String(word(number)); });
+
+    run<std::string>("std::string ids", count, queries, user_id);
+    run<RB::Short_String>("Short_String ids", count, queries,
+                          [](uint64_t number) { return RB::Short_String(user_id(number)); });
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stddef.h> // for size_t
+
+#include <algorithm> // for sort, lower_bound, upper_bound, max
+#include <cmath>     // for abs
+#include <iomanip>   // for scientific, setprecision
+#include <iostream>  // for cout
+#include <iterator>  // for distance
+#include <string>    // for string, to_string
+#include <vector>    // for vector
+
+#include "KLL_Sketch.h"  // for Sketch
+#include "RB_Tree.h"     // for Tree
+#include "bench_utils.h" // for Stopwatch, report, uniform_keys, zipf_keys
+
+namespace
+{
+
+struct Query
+{
+    int left;
+    int right;
+};
+
+void run(const std::string &name, const std::vector<int> &keys, int range)
+{
+    std::vector<Query> queries;
+    for (int left : bench::uniform_keys(10000, range, 99))
+        queries.push_back({left, left + range / 8});
+
+    std::cout << "--- " << name << ": " << keys.size() << " keys, "
+              << queries.size() << " queries ---\n";
+
+    std::vector<int> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto exact = [&](const Query &query)
+    {
+        return static_cast<double>(
+            std::upper_bound(sorted.begin(), sorted.end(), query.right) -
+            std::lower_bound(sorted.begin(), sorted.end(), query.left));
+    };
+
+    {
+        RB::Tree<int> tree;
+
+        bench::Stopwatch inserts;
+        for (int key : keys)
+            tree.insert(key);
+        bench::report("RB::Tree insert", keys.size(), inserts.seconds());
+
+        bench::Stopwatch counts;
+        for (const Query &query : queries)
+            bench::keep(std::distance(tree.lower_bound(query.left),
+                                      tree.upper_bound(query.right)));
+        bench::report("RB::Tree count", queries.size(), counts.seconds());
+
+        std::cout << "RB::Tree nodes: " << tree.size() << '\n';
+    }
+
+    for (double error : {0.01, 0.001})
+    {
+        auto sketch = KLL::Sketch<int>::with_error(error);
+        std::string label = "KLL eps=" + std::to_string(error).substr(0, 5);
+
+        bench::Stopwatch inserts;
+        for (int key : keys)
+            sketch.insert(key);
+        bench::report(label + " insert", keys.size(), inserts.seconds());
+
+        double total_error = 0;
+        double max_error = 0;
+
+        bench::Stopwatch counts;
+        for (const Query &query : queries)
+        {
+            double estimate =
+                static_cast<double>(sketch.range_count(query.left, query.right));
+            double deviation = std::abs(estimate - exact(query)) /
+                               static_cast<double>(keys.size());
+
+            total_error += deviation;
+            max_error = std::max(max_error, deviation);
+        }
+        bench::report(label + " count", queries.size(), counts.seconds());
+
+        std::cout << std::scientific << std::setprecision(2) << label
+                  << " retained: " << sketch.retained()
+                  << ", rank error mean: "
+                  << total_error / static_cast<double>(queries.size())
+                  << " max: " << max_error << '\n';
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 1000000);
+
+    run("uniform", bench::uniform_keys(count, 1 << 30), 1 << 30);
+    run("zipf 1.1", bench::zipf_keys(count, 1 << 20, 1.1), 1 << 20);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stddef.h> // for size_t
+
+#include <iostream> // for cout
+#include <string>   // for string
+#include <vector>   // for vector
+
+#include "RB_Tree.h"     // for Tree
+#include "bench_utils.h" // for Stopwatch, report, keep, uniform_keys
+
+namespace
+{
+
+/* Orders ints like std::less but isn't recognized as it, so the tree takes
+ * its generic three-way descents. */
+struct Plain_Less
+{
+    bool operator()(int lhs, int rhs) const { return lhs < rhs; }
+};
+
+template <typename Tree>
+void measure(const std::string &name, const std::vector<int> &keys,
+             const std::vector<int> &probes)
+{
+    Tree tree;
+
+    bench::Stopwatch inserts;
+    for (int key : keys)
+        tree.insert(key);
+    bench::report(name + " insert", keys.size(), inserts.seconds());
+
+    size_t found = 0;
+    bench::Stopwatch lookups;
+    for (int probe : probes)
+        found += tree.lower_bound(probe) != tree.end();
+    bench::report(name + " lower_bound", probes.size(), lookups.seconds());
+    bench::keep(found);
+
+    size_t total = 0;
+    bench::Stopwatch counts;
+    for (int left : probes)
+        total += tree.range_count(left, left + (1 << 16));
+    bench::report(name + " range_count", probes.size(), counts.seconds());
+    bench::keep(total);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 1000000);
+    size_t queries = 2000000;
+
+    std::vector<int> keys = bench::uniform_keys(count, 1 << 30, 1);
+    std::vector<int> probes = bench::uniform_keys(queries, 1 << 30, 2);
+
+    std::cout << "--- " << count << " random keys, " << queries << " probes ---\n";
+    measure<RB::Tree<int>>("branchless (std::less)", keys, probes);
+    measure<RB::Tree<int, std::less<>>>("branchless (std::less<>)", keys, probes);
+    measure<RB::Tree<int, Plain_Less>>("three-way (other comparator)", keys, probes);
+
+    return 0;
+}
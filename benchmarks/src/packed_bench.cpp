@@ -0,0 +1,89 @@
+#include <stddef.h> // for size_t
+
+#include <algorithm> // for sort, unique
+#include <iostream>  // for cout
+#include <string>    // for string
+#include <vector>    // for vector
+
+#include "Packed_Set.h"   // for Set
+#include "RB_Tree.h"      // for Tree
+#include "Sorted_Array.h" // for Array
+#include "bench_utils.h"  // for Stopwatch, report, uniform_keys
+
+namespace
+{
+
+void compare(const std::string &name, std::vector<int> keys, size_t queries, int width)
+{
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<int> bounds =
+        bench::uniform_keys(queries, keys.back() - keys.front() + 1, 7);
+    for (int &bound : bounds)
+        bound += keys.front();
+
+    RB::Tree<int> tree;
+    tree.assign_sorted(keys.begin(), keys.end());
+
+    Sorted::Array<int> array;
+    array.assign_sorted(keys.begin(), keys.end());
+
+    bench::Stopwatch build;
+    Packed::Set<int> packed(tree);
+    double build_seconds = build.seconds();
+
+    std::cout << "--- " << name << ": " << keys.size() << " keys, Packed::Set "
+              << packed.bits_per_key() << " bits/key (raw keys: " << 8 * sizeof(int)
+              << ") ---\n";
+    bench::report("Packed::Set build", keys.size(), build_seconds);
+
+    size_t expected = 0;
+    {
+        bench::Stopwatch counts;
+        for (int left : bounds)
+            expected += tree.range_count(left, left + width);
+        bench::report("RB::Tree range_count", bounds.size(), counts.seconds());
+    }
+
+    size_t sorted_total = 0;
+    {
+        bench::Stopwatch counts;
+        for (int left : bounds)
+            sorted_total += array.range_count(left, left + width);
+        bench::report("Sorted::Array range_count", bounds.size(), counts.seconds());
+    }
+
+    size_t packed_total = 0;
+    {
+        bench::Stopwatch counts;
+        for (int left : bounds)
+            packed_total += packed.range_count(left, left + width);
+        bench::report("Packed::Set range_count", bounds.size(), counts.seconds());
+    }
+
+    if (sorted_total != expected || packed_total != expected)
+        std::cout << "MISMATCH: " << sorted_total << ", " << packed_total << " vs "
+                  << expected << '\n';
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 10000000);
+    size_t queries = 1000000;
+
+    std::vector<int> dense(count);
+    for (size_t id = 0; id < count; ++id)
+        dense[id] = static_cast<int>(id);
+    compare("dense IDs", dense, queries, 1000);
+
+    /* IDs handed out in runs, with a few retired in between. */
+    std::vector<int> clustered = bench::uniform_keys(count, static_cast<int>(count) * 5 / 4, 8);
+    compare("clustered IDs", clustered, queries, 1000);
+
+    compare("uniform keys", bench::uniform_keys(count, 1 << 30, 9), queries, 1 << 16);
+
+    return 0;
+}
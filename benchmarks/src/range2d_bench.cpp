@@ -0,0 +1,185 @@
+#include <stddef.h> // for size_t
+
+#include <iostream> // for cout
+#include <iterator> // for distance
+#include <random>   // for mt19937_64, uniform_int_distribution
+#include <vector>   // for vector
+
+#include "RB_Tree.h"     // for Tree
+#include "Range_Tree.h"  // for Static_Tree, Dynamic_Tree
+#include "bench_utils.h" // for Stopwatch, report, keep
+
+namespace
+{
+
+/* Points are (timestamp, value) pairs; the baseline keeps one RB::Tree of
+ * values per time bucket, as running range_queries.x per bucket would. */
+constexpr int bucket_width = 1000;
+constexpr int value_range = 1 << 30;
+
+struct Rectangle
+{
+    int x1, y1, x2, y2;
+};
+
+/* Values are a scrambled permutation, so the set-based baseline doesn't
+ * drop duplicates the multiset engines count. */
+std::vector<Range::Point<int>> make_points(size_t count)
+{
+    std::vector<Range::Point<int>> points(count);
+    for (size_t id = 0; id < count; ++id)
+        points[id] = {static_cast<int>(id),
+                      static_cast<int>((id * 2654435761ULL) % value_range)};
+
+    return points;
+}
+
+/* Time ranges cover whole buckets, so the baseline answers exactly. */
+std::vector<Rectangle> make_queries(size_t count, size_t points, int max_buckets)
+{
+    std::mt19937_64 generator(4);
+    int buckets = static_cast<int>(points) / bucket_width;
+    std::uniform_int_distribution<int> first_bucket(0, buckets - 1);
+    std::uniform_int_distribution<int> span(1, max_buckets);
+    std::uniform_int_distribution<int> values(0, value_range - 1);
+
+    std::vector<Rectangle> queries(count);
+    for (Rectangle &query : queries)
+    {
+        int first = first_bucket(generator);
+        int low = values(generator);
+
+        query = {first * bucket_width, low,
+                 (first + span(generator)) * bucket_width - 1, low + value_range / 16};
+    }
+
+    return queries;
+}
+
+class Bucketed
+{
+  private:
+    std::vector<RB::Tree<int>> buckets_;
+
+  public:
+    void insert(int x, int y)
+    {
+        size_t bucket = static_cast<size_t>(x / bucket_width);
+
+        if (buckets_.size() <= bucket)
+            buckets_.resize(bucket + 1);
+
+        buckets_[bucket].insert(y);
+    }
+
+    size_t count(const Rectangle &query) const
+    {
+        size_t result = 0;
+
+        for (size_t bucket = static_cast<size_t>(query.x1 / bucket_width);
+             bucket <= static_cast<size_t>(query.x2 / bucket_width) && bucket < buckets_.size();
+             ++bucket)
+            result += static_cast<size_t>(
+                std::distance(buckets_[bucket].lower_bound(query.y1),
+                              buckets_[bucket].upper_bound(query.y2)));
+
+        return result;
+    }
+};
+
+void run(size_t count, int max_buckets)
+{
+    std::vector<Range::Point<int>> points = make_points(count);
+    std::vector<Rectangle> queries = make_queries(10000, count, max_buckets);
+
+    std::cout << "--- " << count << " points, " << queries.size()
+              << " queries over up to " << max_buckets << " buckets ---\n";
+
+    size_t expected = 0;
+    {
+        Bucketed baseline;
+
+        bench::Stopwatch inserts;
+        for (const auto &point : points)
+            baseline.insert(point.x, point.y);
+        bench::report("per-bucket RB::Tree insert", points.size(), inserts.seconds());
+
+        bench::Stopwatch counts;
+        for (const Rectangle &query : queries)
+            expected += baseline.count(query);
+        bench::report("per-bucket RB::Tree count", queries.size(), counts.seconds());
+    }
+
+    {
+        bench::Stopwatch build;
+        Range::Static_Tree<int> tree(points);
+        bench::report("Static_Tree build", points.size(), build.seconds());
+
+        size_t total = 0;
+        bench::Stopwatch counts;
+        for (const Rectangle &query : queries)
+            total += tree.count(query.x1, query.y1, query.x2, query.y2);
+        bench::report("Static_Tree count", queries.size(), counts.seconds());
+
+        if (total != expected)
+            std::cout << "MISMATCH: " << total << " vs " << expected << '\n';
+    }
+
+    {
+        Range::Dynamic_Tree<int> tree;
+
+        bench::Stopwatch inserts;
+        for (const auto &point : points)
+            tree.insert(point.x, point.y);
+        bench::report("Dynamic_Tree insert", points.size(), inserts.seconds());
+
+        std::cout << "Dynamic_Tree trees before the first query: " << tree.trees() << '\n';
+
+        size_t total = 0;
+        bench::Stopwatch counts;
+        for (const Rectangle &query : queries)
+            total += tree.count(query.x1, query.y1, query.x2, query.y2);
+        bench::report("Dynamic_Tree count (folds once)", queries.size(), counts.seconds());
+
+        if (total != expected)
+            std::cout << "MISMATCH: " << total << " vs " << expected << '\n';
+    }
+
+    /* Online: every insert is followed by a query over all buckets so far. */
+    {
+        Range::Dynamic_Tree<int> tree;
+        Bucketed baseline;
+        size_t online = points.size() / 100;
+
+        bench::Stopwatch mixed_tree;
+        for (size_t id = 0; id < online; ++id)
+        {
+            tree.insert(points[id].x, points[id].y);
+            const Rectangle &query = queries[id % queries.size()];
+            bench::keep(tree.count(0, query.y1, points[id].x, query.y2));
+        }
+        bench::report("Dynamic_Tree insert+count", 2 * online, mixed_tree.seconds());
+
+        bench::Stopwatch mixed_baseline;
+        for (size_t id = 0; id < online; ++id)
+        {
+            baseline.insert(points[id].x, points[id].y);
+            const Rectangle &query = queries[id % queries.size()];
+            bench::keep(baseline.count({0, query.y1, points[id].x, query.y2}));
+        }
+        bench::report("per-bucket RB::Tree insert+count", 2 * online,
+                      mixed_baseline.seconds());
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 1000000);
+
+    run(count, 4);
+    run(count, 64);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <stddef.h> // for size_t
+
+#include <iostream> // for cout
+#include <string>   // for string
+#include <vector>   // for vector
+
+#include "RB_Tree.h"     // for Tree
+#include "Splay_Tree.h"  // for Tree
+#include "Treap.h"       // for Tree
+#include "bench_utils.h" // for Stopwatch, report, uniform_keys, zipf_keys
+
+namespace
+{
+
+constexpr int key_range = 1 << 30;
+constexpr int width = 1 << 12;
+
+/* Inserts `keys`, then counts [left, left + width] for every query bound;
+ * returns the sum of the counts so engines can be cross-checked. */
+template <typename Tree>
+size_t run(const std::string &name, const std::vector<int> &keys,
+           const std::vector<int> &bounds)
+{
+    Tree tree;
+
+    bench::Stopwatch inserts;
+    for (int key : keys)
+        tree.insert(key);
+    bench::report(name + " insert", keys.size(), inserts.seconds());
+
+    size_t total = 0;
+    bench::Stopwatch counts;
+    for (int left : bounds)
+        total += tree.range_count(left, left + width);
+    bench::report(name + " range_count", bounds.size(), counts.seconds());
+
+    return total;
+}
+
+void compare(const std::string &workload, const std::vector<int> &keys,
+             const std::vector<int> &bounds)
+{
+    std::cout << "--- " << keys.size() << " keys, " << bounds.size() << ' ' << workload
+              << " queries ---\n";
+
+    size_t expected = run<RB::Tree<int>>("RB::Tree", keys, bounds);
+
+    for (size_t total : {run<Splay::Tree<int>>("Splay::Tree", keys, bounds),
+                         run<Treap::Tree<int>>("Treap::Tree", keys, bounds)})
+        if (total != expected)
+            std::cout << "MISMATCH: " << total << " vs " << expected << '\n';
+}
+
+/* Query bounds drawn from a Zipf distribution over `hot` distinct ranges. */
+std::vector<int> skewed_bounds(size_t count, int hot, double skew)
+{
+    std::vector<int> bounds = bench::zipf_keys(count, hot, skew, 5);
+    for (int &bound : bounds)
+        bound = static_cast<int>(static_cast<long long>(bound) * (key_range / hot));
+
+    return bounds;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t count = bench::size_arg(argc, argv, 1000000);
+    size_t queries = 2 * count;
+
+    std::vector<int> keys = bench::uniform_keys(count, key_range, 3);
+
+    compare("uniform", keys, bench::uniform_keys(queries, key_range - width, 4));
+    compare("zipf(0.8) over 65536 ranges", keys, skewed_bounds(queries, 1 << 16, 0.8));
+    compare("zipf(1.2) over 65536 ranges", keys, skewed_bounds(queries, 1 << 16, 1.2));
+    compare("repeated, 16 ranges", keys, skewed_bounds(queries, 16, 1.0));
+
+    /* Sorted inserts: a splay tree degenerates into a path but amortizes it. */
+    std::vector<int> sorted(count);
+    for (size_t id = 0; id < count; ++id)
+        sorted[id] = static_cast<int>(id) * 64;
+    compare("uniform, sorted inserts", sorted,
+            bench::uniform_keys(queries, static_cast<int>(count) * 64, 6));
+
+    return 0;
+}
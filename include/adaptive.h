@@ -0,0 +1,242 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stddef.h> // for size_t, ptrdiff_t
+
+#include <algorithm> // for max
+#include <cmath>     // for log2
+#include <iterator>  // for forward_iterator_tag
+#include <optional>  // for optional, nullopt
+
+#include "RB_Tree.h"      // for Tree
+#include "Sorted_Array.h" // for Array
+#include "log.h"
+
+namespace range_queries
+{
+
+/* Engine facade for range_queries::start that picks, per window of commands,
+ * the engine with the lowest estimated cost for the observed workload and
+ * migrates the key set when the choice changes:
+ *
+ *   - RB::Tree: O(log n) inserts and counts, both chasing node pointers;
+ *   - Sorted::Array: counts are two cache-friendly binary searches, inserts
+ *     shift O(n) keys.
+ *
+ * The estimate uses only the insert/query ratio of the window and the key
+ * count. Key spread and range widths are not modeled: both engines answer a
+ * count with two descents whatever the width, so they would scale both
+ * estimates alike. */
+template <typename T>
+class Adaptive
+{
+  public:
+    enum class Engine
+    {
+        tree,
+        array
+    };
+
+  private:
+    /* Rough per-operation costs in nanoseconds. */
+    static constexpr double descent_level_ = 8.0;
+    static constexpr double search_level_ = 2.0;
+    static constexpr double shifted_key_ = 0.1;
+
+    /* A switch must at least halve the estimated cost, so that a workload
+     * sitting on the boundary doesn't migrate back and forth. */
+    static constexpr double hysteresis_ = 0.5;
+
+    RB::Tree<T> tree_;
+    Sorted::Array<T> array_;
+    Engine engine_ = Engine::tree;
+
+    size_t window_;
+    size_t seen_ = 0;
+    size_t inserts_ = 0;
+    size_t queries_ = 0;
+
+    size_t migrations_ = 0;
+
+    double cost(Engine engine) const
+    {
+        double keys = std::max(2.0, static_cast<double>(size()));
+        double levels = std::log2(keys);
+        double inserts = static_cast<double>(inserts_);
+        double queries = static_cast<double>(queries_);
+
+        if (engine == Engine::tree)
+            return (inserts + 2 * queries) * descent_level_ * levels;
+
+        return inserts * (search_level_ * levels + shifted_key_ * keys / 2) +
+               queries * 2 * search_level_ * levels;
+    }
+
+    void migrate(Engine engine)
+    {
+        LOG("migrating {} keys to engine {}\n", size(), static_cast<int>(engine));
+
+        if (engine == Engine::array)
+        {
+            array_.assign_sorted(tree_.begin(), tree_.end());
+            tree_ = RB::Tree<T>{};
+        }
+        else
+        {
+            tree_.assign_sorted(array_.begin(), array_.end());
+            array_.clear();
+        }
+
+        engine_ = engine;
+        ++migrations_;
+    }
+
+    void step()
+    {
+        if (++seen_ < window_)
+            return;
+
+        Engine other = engine_ == Engine::tree ? Engine::array : Engine::tree;
+
+        if (cost(other) < hysteresis_ * cost(engine_))
+            migrate(other);
+
+        seen_ = inserts_ = queries_ = 0;
+    }
+
+  public:
+    /* Walks the keys of whichever engine holds them; a migration
+     * invalidates it. */
+    class iterator
+    {
+      private:
+        using Tree_Iterator = typename RB::Tree<T>::iterator;
+        using Array_Iterator = typename Sorted::Array<T>::iterator;
+
+        Tree_Iterator in_tree_;
+        Array_Iterator in_array_;
+        bool tree_ = true;
+
+      public:
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using reference = const T &;
+        using pointer = const T *;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+        explicit iterator(Tree_Iterator in_tree) : in_tree_(in_tree) {}
+        explicit iterator(Array_Iterator in_array) : in_array_(in_array), tree_(false) {}
+
+        const T &operator*() const { return tree_ ? *in_tree_ : *in_array_; }
+
+        iterator &operator++()
+        {
+            if (tree_)
+                ++in_tree_;
+            else
+                ++in_array_;
+
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            return tree_ ? in_tree_ == other.in_tree_ : in_array_ == other.in_array_;
+        }
+    };
+
+    explicit Adaptive(size_t window = 4096)
+        : window_(window == 0 ? 1 : window)
+    {}
+
+    void insert(const T &key)
+    {
+        ++inserts_;
+
+        if (engine_ == Engine::tree)
+            tree_.insert(key);
+        else
+            array_.insert(key);
+
+        step();
+    }
+
+    /* Costs like an insert on either engine, so it is accounted as one. */
+    size_t erase(const T &key)
+    {
+        ++inserts_;
+
+        size_t erased = engine_ == Engine::tree ? tree_.erase(key) : array_.erase(key);
+
+        step();
+
+        return erased;
+    }
+
+    size_t range_count(const T &left_b, const T &right_b)
+    {
+        ++queries_;
+
+        size_t count = engine_ == Engine::tree ? tree_.range_count(left_b, right_b)
+                                               : array_.range_count(left_b, right_b);
+
+        step();
+
+        return count;
+    }
+
+    size_t rank(const T &key)
+    {
+        ++queries_;
+
+        size_t result = engine_ == Engine::tree ? tree_.rank(key) : array_.rank(key);
+
+        step();
+
+        return result;
+    }
+
+    std::optional<T> select(size_t index)
+    {
+        ++queries_;
+
+        std::optional<T> result;
+
+        if (index < size())
+            result = engine_ == Engine::tree ? *tree_.select(index) : *array_.select(index);
+
+        step();
+
+        return result;
+    }
+
+    iterator begin()
+    {
+        return engine_ == Engine::tree ? iterator(tree_.begin()) : iterator(array_.begin());
+    }
+
+    iterator end()
+    {
+        return engine_ == Engine::tree ? iterator(tree_.end()) : iterator(array_.end());
+    }
+
+    size_t size() const
+    {
+        return engine_ == Engine::tree ? tree_.size() : array_.size();
+    }
+
+    Engine engine() const { return engine_; }
+    size_t migrations() const { return migrations_; }
+};
+
+}; // namespace range_queries
+
+#endif // ADAPTIVE_H
@@ -0,0 +1,387 @@
+#ifndef COMMAND_FILE_H
+#define COMMAND_FILE_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for int32_t, int64_t, uint32_t, uint64_t
+
+#include <cstring>     // for memcmp, memcpy
+#include <fstream>     // for ifstream
+#include <ostream>     // for ostream
+#include <stdexcept>   // for runtime_error
+#include <string>      // for string
+#include <type_traits> // for is_integral_v, is_same_v
+
+#include "range_queries.h" // for Command
+#include "snapshot.h"      // for Mapped_File, Key_Type, key_type_name
+
+namespace range_queries
+{
+
+namespace command_file
+{
+
+/* Binary form of the text commands, for producers that want to skip text
+ * formatting and parsing. Layout: Header, then blocks of up to
+ * `block_commands` commands, each a Block_Header followed by `bytes` of
+ * encoded commands, then an empty block marking the end.
+ *
+ * A command is its letter followed by its operands. Keys of integral types
+ * are zigzag LEB128 deltas from the previous key in the block, so sorted or
+ * clustered keys and narrow ranges take a byte or two; other keys and
+ * fractions are raw native-endian bytes; counts are LEB128. Every block
+ * starts from a zero key and decodes on its own. */
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t key_type;
+};
+
+struct Block_Header
+{
+    uint32_t commands;
+    uint32_t bytes;
+};
+
+static constexpr char magic[8] = {'R', 'Q', 'C', 'M', 'D', 'S', '\0', '\0'};
+static constexpr uint32_t version = 1;
+static constexpr uint32_t block_commands = 4096;
+
+using RB::snapshot::Key_Type;
+using RB::snapshot::key_type_name;
+
+/* Key types a command file can hold. */
+template <typename T>
+concept File_Key = std::is_same_v<T, int32_t> || std::is_same_v<T, int64_t> ||
+                   std::is_same_v<T, double>;
+
+template <typename T>
+constexpr Key_Type key_type_of()
+{
+    static_assert(File_Key<T>, "command files hold int32, int64 or double keys");
+
+    return RB::snapshot::key_type_of<T>();
+}
+
+/* Whether `path` starts like a command file. */
+inline bool is_command_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char start[sizeof(magic)] = {};
+
+    return file.read(start, sizeof(start)) &&
+           std::memcmp(start, magic, sizeof(magic)) == 0;
+}
+
+namespace detail
+{
+
+inline uint64_t zigzag(uint64_t delta)
+{
+    return (delta << 1) ^ (0 - (delta >> 63));
+}
+
+inline uint64_t unzigzag(uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+}; // namespace detail
+
+template <typename T>
+class Writer
+{
+  private:
+    std::ostream &out_;
+    std::string block_;
+    uint32_t commands_ = 0;
+    T previous_{};
+
+    void put_varint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            block_.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+
+        block_.push_back(static_cast<char>(value));
+    }
+
+    template <typename Value>
+    void put_raw(const Value &value)
+    {
+        block_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_key(const T &key)
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            put_varint(detail::zigzag(static_cast<uint64_t>(static_cast<int64_t>(key)) -
+                                      static_cast<uint64_t>(static_cast<int64_t>(previous_))));
+            previous_ = key;
+        }
+        else
+            put_raw(key);
+    }
+
+    void put_block(uint32_t commands, const std::string &payload)
+    {
+        Block_Header header{commands, static_cast<uint32_t>(payload.size())};
+
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    }
+
+    void flush()
+    {
+        if (commands_ == 0)
+            return;
+
+        put_block(commands_, block_);
+
+        block_.clear();
+        commands_ = 0;
+        previous_ = T{};
+    }
+
+  public:
+    explicit Writer(std::ostream &out)
+        : out_(out)
+    {
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.key_type = static_cast<uint32_t>(key_type_of<T>());
+
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    void write(const Command<T> &command)
+    {
+        block_.push_back(command.option);
+
+        switch (command.option)
+        {
+            case 'k':
+            case 'n':
+                put_key(command.first);
+                break;
+            case 'q':
+            case 'p':
+                put_key(command.first);
+                put_key(command.second);
+                break;
+            case 'r':
+                put_key(command.first);
+                put_key(command.second);
+                put_key(command.third);
+                put_key(command.fourth);
+                break;
+            case 'w':
+            case 's':
+                put_varint(command.count);
+                break;
+            case 't':
+            case 'f':
+                put_raw(command.real);
+                break;
+            default:
+                throw std::runtime_error(std::string("Unknown command ") +
+                                         command.option);
+        }
+
+        if (++commands_ == block_commands)
+            flush();
+    }
+
+    /* Writes the last block and the end marker. */
+    void finish()
+    {
+        flush();
+        put_block(0, {});
+        out_.flush();
+    }
+};
+
+/* Decodes a mapped command file, one command at a time, without copying. */
+template <typename T>
+class Reader
+{
+  private:
+    const char* cursor_ = nullptr;
+    const char* block_end_ = nullptr;
+    const char* end_ = nullptr;
+    uint32_t left_ = 0; // commands left in the block
+    bool ended_ = false; // the end marker was read
+    T previous_{};
+    std::string path_;
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw std::runtime_error(path_ + ": " + what);
+    }
+
+    template <typename Value>
+    Value get_raw()
+    {
+        if (static_cast<size_t>(block_end_ - cursor_) < sizeof(Value))
+            fail("truncated command");
+
+        Value value;
+        std::memcpy(&value, cursor_, sizeof(Value));
+        cursor_ += sizeof(Value);
+
+        return value;
+    }
+
+    uint64_t get_varint()
+    {
+        uint64_t value = 0;
+
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (cursor_ == block_end_)
+                fail("truncated command");
+
+            auto byte = static_cast<unsigned char>(*cursor_++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+
+        fail("malformed varint");
+    }
+
+    T get_key()
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            previous_ = static_cast<T>(static_cast<int64_t>(
+                static_cast<uint64_t>(static_cast<int64_t>(previous_)) +
+                detail::unzigzag(get_varint())));
+            return previous_;
+        }
+        else
+            return get_raw<T>();
+    }
+
+    /* Moves to the next block; false at the end marker and after it. */
+    bool next_block()
+    {
+        if (ended_)
+            return false;
+
+        if (cursor_ != block_end_)
+            fail("block longer than its commands");
+
+        if (static_cast<size_t>(end_ - cursor_) < sizeof(Block_Header))
+            fail("missing end of commands");
+
+        Block_Header header{};
+        std::memcpy(&header, cursor_, sizeof(header));
+        cursor_ += sizeof(header);
+
+        if (header.commands == 0)
+        {
+            ended_ = true;
+            return false;
+        }
+
+        if (header.bytes > static_cast<size_t>(end_ - cursor_))
+            fail("truncated block");
+
+        block_end_ = cursor_ + header.bytes;
+        left_ = header.commands;
+        previous_ = T{};
+
+        return true;
+    }
+
+  public:
+    Reader(const RB::snapshot::Mapped_File &file, const std::string &path)
+        : path_(path)
+    {
+        Header header{};
+
+        if (file.size() < sizeof(Header))
+            fail("truncated command file header");
+
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+            fail("not a command file");
+
+        if (header.version != version)
+            fail("unsupported command file version " + std::to_string(header.version));
+
+        if (header.key_type != static_cast<uint32_t>(key_type_of<T>()))
+            fail("holds " + key_type_name(header.key_type) + " keys, run with --key " +
+                 key_type_name(header.key_type));
+
+        cursor_ = block_end_ = file.data() + sizeof(Header);
+        end_ = file.data() + file.size();
+    }
+
+    bool next(Command<T> &command)
+    {
+        if (left_ == 0 && !next_block())
+            return false;
+
+        --left_;
+
+        if (cursor_ == block_end_)
+            fail("truncated block");
+
+        command.option = *cursor_++;
+
+        switch (command.option)
+        {
+            case 'k':
+            case 'n':
+                command.first = get_key();
+                break;
+            case 'q':
+            case 'p':
+                command.first = get_key();
+                command.second = get_key();
+                break;
+            case 'r':
+                command.first = get_key();
+                command.second = get_key();
+                command.third = get_key();
+                command.fourth = get_key();
+                break;
+            case 'w':
+            case 's':
+                command.count = static_cast<size_t>(get_varint());
+                break;
+            case 't':
+            case 'f':
+                command.real = get_raw<double>();
+                break;
+            default:
+                fail(std::string("unknown command ") + command.option);
+        }
+
+        return true;
+    }
+};
+
+/* Lets the drivers take a Reader wherever they take an istream. */
+template <typename T>
+inline bool read_command(Reader<T> &in, Command<T> &command)
+{
+    return in.next(command);
+}
+
+}; // namespace command_file
+
+}; // namespace range_queries
+
+#endif // COMMAND_FILE_H
@@ -0,0 +1,124 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <algorithm> // for min, max
+#include <array>     // for array
+#include <bit>       // for bit_width
+#include <ostream>   // for ostream
+#include <string>    // for string
+
+namespace range_queries
+{
+
+/* Log-linear latency histogram: values below 16 are exact, larger ones fall
+ * into 16 linear sub-buckets per power of two (at most 6.25% relative
+ * error). Values are clamped to 2^40, i.e. about 18 minutes in nanoseconds. */
+class Latency_Histogram
+{
+  private:
+    static constexpr unsigned sub_bits_ = 4;
+    static constexpr uint64_t sub_count_ = uint64_t{1} << sub_bits_;
+    static constexpr unsigned max_bits_ = 40;
+    static constexpr size_t bucket_count_ = (max_bits_ - sub_bits_ + 2) * sub_count_;
+
+    std::array<uint64_t, bucket_count_> counts_{};
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    static size_t bucket_of(uint64_t value)
+    {
+        value = std::min(value, (uint64_t{1} << max_bits_) - 1);
+
+        if (value < sub_count_)
+            return static_cast<size_t>(value);
+
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - sub_bits_;
+        uint64_t sub = (value >> shift) & (sub_count_ - 1);
+
+        return static_cast<size_t>((shift + 1) * sub_count_ + sub);
+    }
+
+    /* Midpoint of the values that fall into a bucket. */
+    static uint64_t value_of(size_t bucket)
+    {
+        if (bucket < sub_count_)
+            return bucket;
+
+        unsigned shift = static_cast<unsigned>(bucket / sub_count_) - 1;
+        uint64_t sub = bucket % sub_count_;
+        uint64_t lowest = (sub_count_ + sub) << shift;
+
+        return lowest + ((uint64_t{1} << shift) >> 1);
+    }
+
+  public:
+    void record(uint64_t value, uint64_t times = 1)
+    {
+        counts_[bucket_of(value)] += times;
+        total_ += times;
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const Latency_Histogram &other)
+    {
+        for (size_t id = 0; id < bucket_count_; ++id)
+            counts_[id] += other.counts_[id];
+
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    /* Value below which the given fraction (0..1) of samples falls. */
+    uint64_t percentile(double fraction) const
+    {
+        if (total_ == 0)
+            return 0;
+
+        uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total_));
+        rank = std::min(std::max(rank, uint64_t{1}), total_);
+
+        uint64_t seen = 0;
+        for (size_t id = 0; id < bucket_count_; ++id)
+        {
+            seen += counts_[id];
+            if (seen >= rank)
+                return std::min(value_of(id), max_);
+        }
+
+        return max_;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+};
+
+inline void print_latency(std::ostream &out, const std::string &name,
+                          const Latency_Histogram &latency)
+{
+    auto micros = [](uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+
+    out << name << ": " << latency.count() << " commands, latency us"
+        << " p50 " << micros(latency.percentile(0.50))
+        << " p90 " << micros(latency.percentile(0.90))
+        << " p99 " << micros(latency.percentile(0.99))
+        << " p999 " << micros(latency.percentile(0.999))
+        << " max " << micros(latency.max()) << '\n';
+}
+
+/* The same figures as one JSON object, in nanoseconds. */
+inline std::ostream &write_json(std::ostream &out, const Latency_Histogram &latency)
+{
+    return out << "{\"count\": " << latency.count()
+               << ", \"p50_ns\": " << latency.percentile(0.50)
+               << ", \"p90_ns\": " << latency.percentile(0.90)
+               << ", \"p99_ns\": " << latency.percentile(0.99)
+               << ", \"p999_ns\": " << latency.percentile(0.999)
+               << ", \"max_ns\": " << latency.max() << '}';
+}
+
+}; // namespace range_queries
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,191 @@
+#ifndef NET_H
+#define NET_H
+
+#include <arpa/inet.h>  // for htons, htonl
+#include <errno.h>      // for errno
+#include <netinet/in.h> // for sockaddr_in, INADDR_LOOPBACK
+#include <poll.h>       // for poll, POLLOUT
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint16_t
+#include <sys/socket.h> // for socket, bind, listen, connect, send, recv
+#include <sys/un.h>     // for sockaddr_un
+#include <unistd.h>     // for close, unlink
+
+#include <cstring>      // for memcpy
+#include <stdexcept>    // for invalid_argument
+#include <string>       // for string, stoi
+#include <system_error> // for system_error, generic_category
+
+namespace range_queries
+{
+
+namespace net
+{
+
+/* Local endpoint given as `unix:<path>` or `tcp:<port>`; TCP endpoints are
+ * bound to the loopback interface only. */
+struct Address
+{
+    bool is_unix = true;
+    std::string path;
+    int port = 0;
+};
+
+inline Address parse_address(const std::string &text)
+{
+    Address address;
+
+    if (text.rfind("unix:", 0) == 0 && text.size() > 5)
+    {
+        address.path = text.substr(5);
+
+        if (address.path.size() >= sizeof(sockaddr_un::sun_path))
+            throw std::invalid_argument("Socket path is too long: " + text);
+
+        return address;
+    }
+
+    if (text.rfind("tcp:", 0) == 0)
+    {
+        address.is_unix = false;
+
+        try
+        {
+            address.port = std::stoi(text.substr(4));
+        }
+        catch (const std::exception &)
+        {
+            address.port = -1;
+        }
+
+        if (address.port <= 0 || address.port > 65535)
+            throw std::invalid_argument("Invalid port in " + text);
+
+        return address;
+    }
+
+    throw std::invalid_argument("Address must be unix:<path> or tcp:<port>, got " +
+                                text);
+}
+
+static constexpr int send_timeout_ms = 10000;
+
+namespace detail
+{
+
+inline void throw_errno(const std::string &what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+template <typename Function>
+int with_sockaddr(const Address &address, Function function)
+{
+    if (address.is_unix)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, address.path.c_str(), address.path.size() + 1);
+
+        return function(reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(address.port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    return function(reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+}
+
+}; // namespace detail
+
+inline int listen_on(const Address &address, int backlog = 128)
+{
+    int fd = ::socket(address.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        detail::throw_errno("Can't create socket");
+
+    if (address.is_unix)
+        ::unlink(address.path.c_str());
+    else
+    {
+        int reuse = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    int status = detail::with_sockaddr(address,
+        [fd](const sockaddr *addr, socklen_t size) { return ::bind(fd, addr, size); });
+
+    if (status != 0 || ::listen(fd, backlog) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        detail::throw_errno("Can't listen on socket");
+    }
+
+    return fd;
+}
+
+inline int connect_to(const Address &address)
+{
+    int fd = ::socket(address.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        detail::throw_errno("Can't create socket");
+
+    int status = detail::with_sockaddr(address,
+        [fd](const sockaddr *addr, socklen_t size) { return ::connect(fd, addr, size); });
+
+    if (status != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        detail::throw_errno("Can't connect");
+    }
+
+    return fd;
+}
+
+/* Sends the whole buffer, waiting up to send_timeout_ms for a non-blocking
+ * socket to drain when needed; SIGPIPE is suppressed where possible. */
+inline bool send_all(int fd, const char *data, size_t size)
+{
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+
+    while (size != 0)
+    {
+        ssize_t sent = ::send(fd, data, size, flags);
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd waiter{fd, POLLOUT, 0};
+                if (::poll(&waiter, 1, send_timeout_ms) > 0)
+                    continue;
+            }
+
+            return false;
+        }
+
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+}; // namespace net
+
+}; // namespace range_queries
+
+#endif // NET_H
@@ -0,0 +1,217 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stddef.h> // for size_t
+
+#include <stdexcept> // for invalid_argument
+#include <string>    // for string, stoull, stod
+
+namespace range_queries
+{
+
+struct Options
+{
+    std::string key_type = "int32";
+    std::string engine = "rb";
+    size_t auto_window = 4096;
+    double kll_error = 0.01;
+    bool pipeline = false;
+    std::string input_path;
+    size_t cache_entries = 0;
+
+    bool profile = false;
+    std::string profile_json_path;
+    size_t profile_interval_ms = 1000;
+
+    std::string load_path;
+    std::string save_path;
+
+    std::string wal_dir;
+    size_t wal_sync_ops = 64;
+    size_t wal_sync_ms = 10;
+    size_t wal_checkpoint_ops = 1 << 20;
+
+    std::string listen_address;
+    size_t threads = 0;
+    bool session_trees = false;
+};
+
+inline const char *usage()
+{
+    return "Usage: range_queries.x [options] < commands\n"
+           "\t--key <int32|int64|double|string>    key type (default int32)\n"
+           "\t--engine <rb|set|sorted|splay|treap|auto|kll>    backend (default rb)\n"
+           "\t--auto-window <n>  commands per auto re-evaluation (default 4096)\n"
+           "\t--kll-error <e>    relative rank error of the kll engine (default 0.01)\n"
+           "\t--pipeline     parse, execute and print on three threads\n"
+           "\t--input <path>  read commands from a text or binary command file\n"
+           "\t--cache <n>     memoize up to n range counts between changes\n"
+           "\t--profile       print per-command latency and throughput on exit\n"
+           "\t--profile-json <path>      also append JSON snapshots while running\n"
+           "\t--profile-interval-ms <ms> time between snapshots (default 1000)\n"
+           "\t--load <path>   start from a tree snapshot\n"
+           "\t--save <path>   write a tree snapshot on exit\n"
+           "\t--wal <dir>     recover from and log changes to a write-ahead log\n"
+           "\t--wal-sync-ops <n>         group-commit every n inserts (0: off)\n"
+           "\t--wal-sync-ms <ms>         group-commit every ms milliseconds (0: off)\n"
+           "\t--wal-checkpoint-ops <n>   checkpoint every n inserts (0: off)\n"
+           "\t--listen <unix:path|tcp:port>   serve clients instead of stdin\n"
+           "\t--threads <n>      server worker threads (default: all cores)\n"
+           "\t--session-trees    give every server session its own tree\n";
+}
+
+inline Options parse_options(int argc, char **argv)
+{
+    Options options;
+
+    for (int id = 1; id < argc; ++id)
+    {
+        std::string arg = argv[id];
+
+        auto value = [&]() -> std::string
+        {
+            if (id + 1 >= argc)
+                throw std::invalid_argument(arg + " expects a value\n" +
+                                            usage());
+            return argv[++id];
+        };
+
+        auto number = [&]() -> size_t
+        {
+            std::string text = value();
+
+            size_t parsed = 0;
+            size_t length = 0;
+
+            try
+            {
+                parsed = std::stoull(text, &length);
+            }
+            catch (const std::exception &)
+            {
+                length = 0;
+            }
+
+            if (length == 0 || length != text.size())
+                throw std::invalid_argument(arg + " expects a number, got " +
+                                            text);
+            return parsed;
+        };
+
+        auto real = [&]() -> double
+        {
+            std::string text = value();
+
+            size_t length = 0;
+            double parsed = 0;
+
+            try
+            {
+                parsed = std::stod(text, &length);
+            }
+            catch (const std::exception &)
+            {
+                length = 0;
+            }
+
+            if (length == 0 || length != text.size())
+                throw std::invalid_argument(arg + " expects a number, got " +
+                                            text);
+            return parsed;
+        };
+
+        if (arg == "--key")
+            options.key_type = value();
+        else if (arg == "--engine")
+            options.engine = value();
+        else if (arg == "--auto-window")
+            options.auto_window = number();
+        else if (arg == "--kll-error")
+            options.kll_error = real();
+        else if (arg == "--pipeline")
+            options.pipeline = true;
+        else if (arg == "--input")
+            options.input_path = value();
+        else if (arg == "--cache")
+            options.cache_entries = number();
+        else if (arg == "--profile")
+            options.profile = true;
+        else if (arg == "--profile-json")
+        {
+            options.profile = true;
+            options.profile_json_path = value();
+        }
+        else if (arg == "--profile-interval-ms")
+            options.profile_interval_ms = number();
+        else if (arg == "--load")
+            options.load_path = value();
+        else if (arg == "--save")
+            options.save_path = value();
+        else if (arg == "--wal")
+            options.wal_dir = value();
+        else if (arg == "--wal-sync-ops")
+            options.wal_sync_ops = number();
+        else if (arg == "--wal-sync-ms")
+            options.wal_sync_ms = number();
+        else if (arg == "--wal-checkpoint-ops")
+            options.wal_checkpoint_ops = number();
+        else if (arg == "--listen")
+            options.listen_address = value();
+        else if (arg == "--threads")
+            options.threads = number();
+        else if (arg == "--session-trees")
+            options.session_trees = true;
+        else
+            throw std::invalid_argument("Unknown option " + arg + '\n' +
+                                        usage());
+    }
+
+    if (options.key_type != "int32" && options.key_type != "int64" &&
+        options.key_type != "double" && options.key_type != "string")
+        throw std::invalid_argument("Unknown key type " + options.key_type +
+                                    '\n' + usage());
+
+    if (options.engine != "rb" && options.engine != "set" &&
+        options.engine != "sorted" && options.engine != "splay" &&
+        options.engine != "treap" && options.engine != "auto" &&
+        options.engine != "kll")
+        throw std::invalid_argument("Unknown engine " + options.engine + '\n' +
+                                    usage());
+
+    bool uses_tree = !options.load_path.empty() || !options.save_path.empty() ||
+                     !options.wal_dir.empty() || !options.listen_address.empty();
+
+    if (uses_tree && options.engine != "rb")
+        throw std::invalid_argument("--load, --save, --wal and --listen need "
+                                    "the rb engine");
+
+    if (uses_tree && options.key_type == "string")
+        throw std::invalid_argument("--load, --save, --wal and --listen store "
+                                    "keys as raw bytes and take no string keys");
+
+    if (!options.wal_dir.empty() && !options.load_path.empty())
+        throw std::invalid_argument("--load can't be combined with --wal: the "
+                                    "log directory holds its own checkpoint");
+
+    if (!options.listen_address.empty() && !options.wal_dir.empty())
+        throw std::invalid_argument("--wal is not supported in server mode");
+
+    if (!options.listen_address.empty() && !options.input_path.empty())
+        throw std::invalid_argument("--input is not supported in server mode");
+
+    if (!options.listen_address.empty() && options.cache_entries != 0)
+        throw std::invalid_argument("--cache is not supported in server mode");
+
+    if (!options.listen_address.empty() && options.profile)
+        throw std::invalid_argument("--profile is not supported in server mode: "
+                                    "the server reports latency itself");
+
+    if (options.profile_interval_ms == 0)
+        throw std::invalid_argument("--profile-interval-ms must be positive");
+
+    return options;
+}
+
+}; // namespace range_queries
+
+#endif // OPTIONS_H
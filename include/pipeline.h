@@ -0,0 +1,176 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h> // for size_t
+
+#include <atomic>  // for atomic, memory_order
+#include <chrono>  // for steady_clock, duration
+#include <ostream> // for ostream
+#include <thread>  // for yield
+#include <utility> // for swap
+#include <vector>  // for vector
+
+namespace range_queries
+{
+
+/* Bounded single-producer/single-consumer queue. The producer only writes
+ * tail_, the consumer only head_, each on its own cache line, so a push or
+ * pop is one acquire load and one release store; both sides keep a cached
+ * copy of the other index and reload it only when the queue looks full or
+ * empty. Either side may close() the queue: pushes then fail, and pops fail
+ * once the queue is drained.
+ *
+ * Items are swapped in and out rather than moved, so buffers passed through
+ * circulate with their capacity: a push hands back a buffer the consumer is
+ * done with (or an empty one), which the producer clears and refills. */
+template <typename Item>
+class Spsc_Ring
+{
+  private:
+    static constexpr size_t cache_line_ = 64;
+
+    std::vector<Item> slots_;
+    size_t mask_;
+
+    alignas(cache_line_) std::atomic<size_t> head_{0}; // next slot to pop
+    size_t cached_tail_ = 0;
+
+    alignas(cache_line_) std::atomic<size_t> tail_{0}; // next slot to push
+    size_t cached_head_ = 0;
+
+    alignas(cache_line_) std::atomic<bool> closed_{false};
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t result = 1;
+        while (result < capacity)
+            result *= 2;
+        return result;
+    }
+
+    template <typename Try>
+    static double wait(Try try_once)
+    {
+        if (try_once())
+            return 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        while (!try_once())
+            std::this_thread::yield();
+
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+  public:
+    /* Capacity is rounded up to a power of two. */
+    explicit Spsc_Ring(size_t capacity)
+        : slots_(round_up(capacity))
+        , mask_(slots_.size() - 1)
+    {}
+
+    Spsc_Ring(const Spsc_Ring &) = delete;
+    Spsc_Ring &operator=(const Spsc_Ring &) = delete;
+
+    size_t capacity() const { return slots_.size(); }
+
+    bool try_push(Item &item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail - cached_head_ == slots_.size())
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size())
+                return false;
+        }
+
+        std::swap(slots_[tail & mask_], item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(Item &item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+
+        std::swap(item, slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Blocking push; adds the time spent waiting for room to `stalled`.
+     * Returns false if the queue was closed. */
+    bool push(Item &item, double &stalled)
+    {
+        bool pushed = false;
+
+        stalled += wait([&] { return closed() || (pushed = try_push(item)); });
+
+        return pushed;
+    }
+
+    /* Blocking pop; adds the time spent waiting for an item to `stalled`.
+     * Returns false once the queue is closed and drained. */
+    bool pop(Item &item, double &stalled)
+    {
+        bool popped = false;
+
+        stalled += wait(
+            [&]
+            {
+                if (try_pop(item))
+                    return popped = true;
+
+                if (!closed())
+                    return false;
+
+                /* A push may land between the failed pop and the close. */
+                popped = try_pop(item);
+                return true;
+            });
+
+        return popped;
+    }
+
+    void close() { closed_.store(true, std::memory_order_release); }
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+};
+
+/* What one pipeline stage did: `items` commands or answers, `seconds` of
+ * wall time, of which `stalled` waiting on a neighbouring stage. */
+struct Stage_Stats
+{
+    const char *name = "";
+    size_t items = 0;
+    size_t batches = 0;
+    double seconds = 0;
+    double stalled = 0;
+
+    /* Items per second of the time the stage wasn't stalled. */
+    double throughput() const
+    {
+        double busy = seconds - stalled;
+        return busy > 0 ? static_cast<double>(items) / busy : 0;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &out, const Stage_Stats &stats)
+{
+    return out << stats.name << ": " << stats.items << " items in " << stats.batches
+               << " batches, " << stats.seconds * 1e3 << " ms, stalled "
+               << stats.stalled * 1e3 << " ms, " << stats.throughput() / 1e6
+               << " M items/s busy";
+}
+
+}; // namespace range_queries
+
+#endif // PIPELINE_H
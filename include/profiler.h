@@ -0,0 +1,270 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <array>       // for array
+#include <chrono>      // for steady_clock, duration, milliseconds
+#include <limits>      // for numeric_limits
+#include <memory>      // for unique_ptr, make_unique
+#include <ostream>     // for ostream
+#include <string>      // for string, to_string
+#include <thread>      // for sleep_for
+#include <type_traits> // for is_arithmetic_v
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // for __rdtsc
+#define RANGE_QUERIES_TSC
+#endif
+
+#include "histogram.h" // for Latency_Histogram, print_latency, write_json
+
+namespace range_queries
+{
+
+/* Timestamps cheap enough to take around every command: the time stamp
+ * counter, calibrated once against steady_clock, where there is one, and
+ * steady_clock nanoseconds elsewhere. */
+class Tick_Clock
+{
+  private:
+    using clock = std::chrono::steady_clock;
+
+    double nanos_per_tick_ = 1;
+
+  public:
+    Tick_Clock()
+    {
+#ifdef RANGE_QUERIES_TSC
+        auto wall = clock::now();
+        uint64_t first = now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        uint64_t ticks = now() - first;
+        double nanos = std::chrono::duration<double, std::nano>(clock::now() - wall).count();
+
+        if (ticks != 0)
+            nanos_per_tick_ = nanos / static_cast<double>(ticks);
+#endif // RANGE_QUERIES_TSC
+    }
+
+    static uint64_t now()
+    {
+#ifdef RANGE_QUERIES_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now().time_since_epoch())
+                .count());
+#endif // RANGE_QUERIES_TSC
+    }
+
+    uint64_t nanos(uint64_t ticks) const
+    {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * nanos_per_tick_);
+    }
+
+    uint64_t ticks(double nanos) const
+    {
+        return static_cast<uint64_t>(nanos / nanos_per_tick_);
+    }
+};
+
+/* Per-command latency of a run: one histogram for 'k', one per range width
+ * decade for 'q' and one for everything else. Width buckets are: empty
+ * ranges, widths below 1, 10, ..., 1e9, wider ones, and ranges of keys
+ * without a width. Optionally writes a JSON snapshot line every interval;
+ * snapshots, like the report, cover the run so far. The histograms are
+ * tens of kilobytes, so they live on the heap rather than in the caller's
+ * frame. */
+class Profiler
+{
+  public:
+    static constexpr size_t width_decades = 10;
+    static constexpr size_t width_buckets = width_decades + 3;
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t empty_bucket_ = 0;
+    static constexpr size_t wide_bucket_ = width_decades + 1;
+    static constexpr size_t unmeasured_bucket_ = width_decades + 2;
+
+    Tick_Clock clock_;
+    clock::time_point started_ = clock::now();
+
+    struct Histograms
+    {
+        Latency_Histogram inserts;
+        std::array<Latency_Histogram, width_buckets> queries;
+        Latency_Histogram others;
+    };
+
+    std::unique_ptr<Histograms> histograms_ = std::make_unique<Histograms>();
+
+    std::ostream *snapshots_ = nullptr;
+    uint64_t interval_ = 0; // in ticks
+    uint64_t next_snapshot_ = std::numeric_limits<uint64_t>::max();
+
+    static std::string width_label(size_t bucket)
+    {
+        if (bucket == empty_bucket_)
+            return "empty";
+        if (bucket == unmeasured_bucket_)
+            return "any width";
+        if (bucket == wide_bucket_)
+            return "width >= 1e" + std::to_string(width_decades - 1);
+
+        return "width < 1e" + std::to_string(bucket - 1);
+    }
+
+    Latency_Histogram all_queries() const
+    {
+        Latency_Histogram all;
+        for (const Latency_Histogram &bucket : histograms_->queries)
+            all.merge(bucket);
+
+        return all;
+    }
+
+  public:
+    Profiler() = default;
+
+    /* Also writes a snapshot to `snapshots` every `interval`. */
+    Profiler(std::ostream &snapshots, std::chrono::milliseconds interval)
+        : snapshots_(&snapshots)
+        , interval_(clock_.ticks(std::chrono::duration<double, std::nano>(interval).count()))
+        , next_snapshot_(Tick_Clock::now() + interval_)
+    {}
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    static uint64_t now() { return Tick_Clock::now(); }
+
+    /* Bucket of a query from left_b to right_b. */
+    template <typename T>
+    static size_t width_bucket(const T &left_b, const T &right_b)
+    {
+        if constexpr (std::is_arithmetic_v<T>)
+        {
+            double width = static_cast<double>(right_b) - static_cast<double>(left_b);
+
+            if (!(width >= 0)) // also NaN bounds
+                return empty_bucket_;
+
+            double limit = 1;
+            for (size_t decade = 0; decade < width_decades; ++decade, limit *= 10)
+                if (width < limit)
+                    return decade + 1;
+
+            return wide_bucket_;
+        }
+        else
+            return right_b < left_b ? empty_bucket_ : unmeasured_bucket_;
+    }
+
+    /* Charges `commands` commands of kind `option` (of width `bucket` for
+     * 'q') that started at tick `began` and end now; each gets an equal
+     * share of the time. */
+    void record(char option, size_t bucket, uint64_t began, uint64_t commands = 1)
+    {
+        uint64_t ended = now();
+        uint64_t nanos = clock_.nanos(ended - began) / commands;
+
+        switch (option)
+        {
+            case 'k':
+                histograms_->inserts.record(nanos, commands);
+                break;
+            case 'q':
+                histograms_->queries[bucket].record(nanos, commands);
+                break;
+            default:
+                histograms_->others.record(nanos, commands);
+        }
+
+        if (ended >= next_snapshot_)
+        {
+            write_json(*snapshots_);
+            *snapshots_ << std::endl;
+            next_snapshot_ = now() + interval_;
+        }
+    }
+
+    uint64_t commands() const
+    {
+        return inserts().count() + all_queries().count() + others().count();
+    }
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(clock::now() - started_).count();
+    }
+
+    double ops_per_second() const
+    {
+        double elapsed = seconds();
+        return elapsed > 0 ? static_cast<double>(commands()) / elapsed : 0;
+    }
+
+    const Latency_Histogram &inserts() const { return histograms_->inserts; }
+    const Latency_Histogram &queries(size_t bucket) const
+    {
+        return histograms_->queries[bucket];
+    }
+    const Latency_Histogram &others() const { return histograms_->others; }
+
+    /* Throughput and percentiles of every kind of command that ran. */
+    void report(std::ostream &out) const
+    {
+        Latency_Histogram all = all_queries();
+
+        out << "profile: " << commands() << " commands in " << seconds() << " s, "
+            << ops_per_second() << " ops/sec\n";
+
+        if (inserts().count() != 0)
+            print_latency(out, "k", inserts());
+
+        if (all.count() != 0)
+            print_latency(out, "q", all);
+
+        for (size_t bucket = 0; bucket < width_buckets; ++bucket)
+            if (queries(bucket).count() != 0)
+                print_latency(out, "q " + width_label(bucket), queries(bucket));
+
+        if (others().count() != 0)
+            print_latency(out, "other", others());
+    }
+
+    /* The report as one line of JSON. */
+    std::ostream &write_json(std::ostream &out) const
+    {
+        out << "{\"seconds\": " << seconds() << ", \"commands\": " << commands()
+            << ", \"ops_per_sec\": " << ops_per_second() << ", \"k\": ";
+        range_queries::write_json(out, inserts()) << ", \"q\": ";
+        range_queries::write_json(out, all_queries()) << ", \"q_by_width\": [";
+
+        const char *separator = "";
+        for (size_t bucket = 0; bucket < width_buckets; ++bucket)
+        {
+            if (queries(bucket).count() == 0)
+                continue;
+
+            out << separator << "{\"width\": \"" << width_label(bucket)
+                << "\", \"latency\": ";
+            range_queries::write_json(out, queries(bucket)) << '}';
+            separator = ", ";
+        }
+
+        out << "], \"other\": ";
+        return range_queries::write_json(out, others()) << '}';
+    }
+};
+
+}; // namespace range_queries
+
+#endif // PROFILER_H
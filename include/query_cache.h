@@ -0,0 +1,305 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#include <cstring>     // for memcmp
+#include <functional>  // for hash
+#include <iterator>    // for distance
+#include <optional>    // for optional, nullopt
+#include <ostream>     // for ostream
+#include <type_traits> // for is_floating_point_v
+#include <vector>      // for vector
+
+namespace range_queries
+{
+
+struct Cache_Stats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t invalidations = 0;
+
+    double hit_rate() const
+    {
+        size_t lookups = hits + misses;
+        return lookups == 0 ? 0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &out, const Cache_Stats &stats)
+{
+    return out << "cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+               << stats.hit_rate() * 100 << "% hit rate), " << stats.invalidations
+               << " invalidations";
+}
+
+/* Range counts by (left, right) bound, in a fixed table probed linearly
+ * over at most max_probes_ slots. Every entry carries the epoch it was
+ * stored in and only entries of the current epoch are valid, so a change
+ * to the engine invalidates the whole table in O(1) by bumping the epoch.
+ *
+ * Entries are never removed within an epoch, so a lookup stops at the
+ * first stale slot; when all probed slots are taken, the new entry evicts
+ * the one in its home slot. */
+template <typename T>
+class Query_Cache
+{
+  private:
+    static constexpr size_t max_probes_ = 8;
+
+    struct Entry
+    {
+        T left{};
+        T right{};
+        size_t count = 0;
+        uint64_t epoch = 0;
+    };
+
+    std::vector<Entry> entries_;
+    size_t mask_;
+    uint64_t epoch_ = 1; // 0 marks slots never written
+    Cache_Stats stats_;
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t result = max_probes_;
+        while (result < capacity)
+            result *= 2;
+        return result;
+    }
+
+    size_t home(const T &left_b, const T &right_b) const
+    {
+        uint64_t hash = std::hash<T>{}(left_b) * 0x9E3779B97F4A7C15ULL +
+                        std::hash<T>{}(right_b);
+
+        hash ^= hash >> 29;
+        hash *= 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 32;
+
+        return static_cast<size_t>(hash) & mask_;
+    }
+
+    /* Floating bounds compare bitwise: exact, and a NaN matches itself. */
+    static bool same(const T &lhs, const T &rhs)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+            return std::memcmp(&lhs, &rhs, sizeof(T)) == 0;
+        else
+            return lhs == rhs;
+    }
+
+    static bool holds(const Entry &entry, const T &left_b, const T &right_b)
+    {
+        return same(entry.left, left_b) && same(entry.right, right_b);
+    }
+
+  public:
+    /* Capacity is rounded up to a power of two. */
+    explicit Query_Cache(size_t capacity)
+        : entries_(round_up(capacity))
+        , mask_(entries_.size() - 1)
+    {}
+
+    size_t capacity() const { return entries_.size(); }
+    const Cache_Stats &stats() const { return stats_; }
+
+    std::optional<size_t> find(const T &left_b, const T &right_b)
+    {
+        size_t slot = home(left_b, right_b);
+
+        for (size_t probe = 0; probe < max_probes_; ++probe)
+        {
+            const Entry &entry = entries_[(slot + probe) & mask_];
+
+            if (entry.epoch != epoch_)
+                break;
+
+            if (holds(entry, left_b, right_b))
+            {
+                ++stats_.hits;
+                return entry.count;
+            }
+        }
+
+        ++stats_.misses;
+        return std::nullopt;
+    }
+
+    void store(const T &left_b, const T &right_b, size_t count)
+    {
+        size_t slot = home(left_b, right_b);
+        Entry* target = &entries_[slot];
+
+        for (size_t probe = 0; probe < max_probes_; ++probe)
+        {
+            Entry &entry = entries_[(slot + probe) & mask_];
+
+            if (entry.epoch != epoch_ || holds(entry, left_b, right_b))
+            {
+                target = &entry;
+                break;
+            }
+        }
+
+        *target = {left_b, right_b, count, epoch_};
+    }
+
+    /* Drops every entry. */
+    void invalidate()
+    {
+        ++epoch_;
+        ++stats_.invalidations;
+    }
+};
+
+/* Engine facade that memoizes range counts, for clients that repeat the
+ * same queries between rare changes. Anything that may change the engine
+ * invalidates the cache, unless the engine reports an unchanged size:
+ * inserts of keys already present and expiry passes that drop nothing keep
+ * it. That holds because each of these calls only adds or only drops keys;
+ * an insert under a window may do both, so it always invalidates. */
+template <typename Tree, typename T>
+class Cached
+{
+  private:
+    Tree &tree_;
+    Query_Cache<T> cache_;
+
+    template <typename Change>
+    void modify(Change change)
+    {
+        if constexpr (requires { tree_.size(); })
+        {
+            size_t before = tree_.size();
+            change();
+
+            if (tree_.size() != before)
+                cache_.invalidate();
+        }
+        else
+        {
+            change();
+            cache_.invalidate();
+        }
+    }
+
+  public:
+    Cached(Tree &tree, size_t capacity)
+        : tree_(tree)
+        , cache_(capacity)
+    {}
+
+    const Cache_Stats &stats() const { return cache_.stats(); }
+
+    void insert(const T &key)
+    {
+        if constexpr (requires { tree_.expiring(); })
+        {
+            if (tree_.expiring())
+            {
+                tree_.insert(key);
+                cache_.invalidate();
+                return;
+            }
+        }
+
+        modify([&] { tree_.insert(key); });
+    }
+
+    template <typename ForwardIt>
+    void insert_sorted(ForwardIt first, ForwardIt last)
+        requires requires(Tree &tree) { tree.insert_sorted(first, last); }
+    {
+        modify([&] { tree_.insert_sorted(first, last); });
+    }
+
+    bool expiring() const
+        requires requires(Tree &tree) { tree.expiring(); }
+    {
+        return tree_.expiring();
+    }
+
+    void expire()
+        requires requires(Tree &tree) { tree.expire(); }
+    {
+        modify([&] { tree_.expire(); });
+    }
+
+    void set_max_inserts(size_t count)
+        requires requires(Tree &tree) { tree.set_max_inserts(count); }
+    {
+        modify([&] { tree_.set_max_inserts(count); });
+    }
+
+    void set_max_age(double seconds)
+        requires requires(Tree &tree) { tree.set_max_age(seconds); }
+    {
+        modify([&] { tree_.set_max_age(seconds); });
+    }
+
+    size_t range_count(const T &left_b, const T &right_b)
+    {
+        if (auto count = cache_.find(left_b, right_b))
+            return *count;
+
+        size_t count = 0;
+
+        if constexpr (requires { tree_.range_count(left_b, right_b); })
+            count = tree_.range_count(left_b, right_b);
+        else
+            count = static_cast<size_t>(
+                std::distance(tree_.lower_bound(left_b), tree_.upper_bound(right_b)));
+
+        cache_.store(left_b, right_b, count);
+        return count;
+    }
+
+    auto lower_bound(const T &key) const
+        requires requires(Tree &tree) { tree.lower_bound(key); }
+    {
+        return tree_.lower_bound(key);
+    }
+
+    auto upper_bound(const T &key) const
+        requires requires(Tree &tree) { tree.upper_bound(key); }
+    {
+        return tree_.upper_bound(key);
+    }
+
+    auto rank(const T &key) const
+        requires requires(Tree &tree) { tree.rank(key); }
+    {
+        return tree_.rank(key);
+    }
+
+    auto select(size_t index) const
+        requires requires(Tree &tree) { tree.select(index); }
+    {
+        return tree_.select(index);
+    }
+
+    auto begin() const
+        requires requires(Tree &tree) { tree.begin(); }
+    {
+        return tree_.begin();
+    }
+
+    auto end() const
+        requires requires(Tree &tree) { tree.end(); }
+    {
+        return tree_.end();
+    }
+
+    size_t size() const
+        requires requires(Tree &tree) { tree.size(); }
+    {
+        return tree_.size();
+    }
+};
+
+}; // namespace range_queries
+
+#endif // QUERY_CACHE_H
@@ -0,0 +1,177 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stddef.h> // for size_t, ptrdiff_t
+
+#include <algorithm>   // for sort, unique, inplace_merge, min, max
+#include <array>       // for array
+#include <iterator>    // for next
+#include <thread>      // for thread
+#include <type_traits> // for is_integral_v, is_signed_v, make_unsigned_t
+#include <vector>      // for vector
+
+namespace range_queries
+{
+
+/* Bursts shorter than this are sorted by one thread. */
+constexpr size_t parallel_sort_size = size_t{1} << 16;
+
+namespace detail
+{
+
+/* Calls work(id) for id in [0, threads), on `threads` threads. */
+template <typename Work>
+inline void run_parallel(unsigned threads, Work work)
+{
+    std::vector<std::thread> workers;
+    for (unsigned id = 1; id < threads; ++id)
+        workers.emplace_back(work, id);
+
+    work(0u);
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+/* Bits of `key` that sort like the key: signed keys get the sign flipped. */
+template <typename T>
+inline std::make_unsigned_t<T> radix_bits(T key)
+{
+    using Bits = std::make_unsigned_t<T>;
+
+    auto bits = static_cast<Bits>(key);
+    if constexpr (std::is_signed_v<T>)
+        bits ^= Bits{1} << (8 * sizeof(T) - 1);
+
+    return bits;
+}
+
+/* LSD radix sort, a byte per pass. Each pass splits the keys into one chunk
+ * per thread; every thread counts the bytes of its chunk, and the prefix sum
+ * over (byte, thread) gives each thread its own slots for every byte, so the
+ * scatter is stable and needs no synchronization. Passes over a byte all
+ * keys share are skipped, which makes narrow key ranges cheap. Returns the
+ * number of passes that moved the keys. */
+template <typename T>
+inline size_t radix_sort(std::vector<T> &keys, unsigned threads)
+{
+    size_t count = keys.size();
+    std::vector<T> buffer(count);
+
+    threads = count < parallel_sort_size ? 1 : threads;
+    size_t chunk = (count + threads - 1) / threads;
+
+    std::vector<std::array<size_t, 256>> offsets(threads);
+    size_t passes = 0;
+
+    for (size_t shift = 0; shift < 8 * sizeof(T); shift += 8)
+    {
+        auto byte_of = [shift](const T &key)
+        { return static_cast<size_t>((radix_bits(key) >> shift) & 0xff); };
+
+        run_parallel(threads,
+                     [&](unsigned id)
+                     {
+                         offsets[id].fill(0);
+
+                         size_t from = std::min(count, id * chunk);
+                         size_t to = std::min(count, from + chunk);
+                         for (size_t key = from; key < to; ++key)
+                             ++offsets[id][byte_of(keys[key])];
+                     });
+
+        size_t total = 0;
+        bool split = false;
+
+        for (size_t byte = 0; byte < 256; ++byte)
+        {
+            size_t first = total;
+
+            for (unsigned id = 0; id < threads; ++id)
+            {
+                size_t bucket = offsets[id][byte];
+
+                offsets[id][byte] = total;
+                total += bucket;
+            }
+
+            split = split || (total != first && total - first != count);
+        }
+
+        if (!split)
+            continue;
+
+        run_parallel(threads,
+                     [&](unsigned id)
+                     {
+                         size_t from = std::min(count, id * chunk);
+                         size_t to = std::min(count, from + chunk);
+                         for (size_t key = from; key < to; ++key)
+                             buffer[offsets[id][byte_of(keys[key])]++] = keys[key];
+                     });
+
+        keys.swap(buffer);
+        ++passes;
+    }
+
+    return passes;
+}
+
+/* Sorts a chunk per thread, then merges neighbouring chunks pairwise. */
+template <typename T>
+inline void merge_sort(std::vector<T> &keys, unsigned threads)
+{
+    size_t count = keys.size();
+    auto at = [&keys](size_t index)
+    { return std::next(keys.begin(), static_cast<std::ptrdiff_t>(index)); };
+
+    threads = count < parallel_sort_size ? 1 : threads;
+    size_t chunk = (count + threads - 1) / threads;
+
+    run_parallel(threads,
+                 [&](unsigned id)
+                 {
+                     size_t from = std::min(count, id * chunk);
+                     size_t to = std::min(count, from + chunk);
+                     std::sort(at(from), at(to));
+                 });
+
+    for (size_t width = chunk; width < count; width *= 2)
+    {
+        size_t pairs = (count + 2 * width - 1) / (2 * width);
+        auto workers = static_cast<unsigned>(std::min<size_t>(threads, pairs));
+
+        run_parallel(workers,
+                     [&](unsigned id)
+                     {
+                         for (size_t pair = id; pair < pairs; pair += workers)
+                         {
+                             size_t from = pair * 2 * width;
+                             size_t middle = std::min(count, from + width);
+                             size_t to = std::min(count, from + 2 * width);
+                             std::inplace_merge(at(from), at(middle), at(to));
+                         }
+                     });
+    }
+}
+
+}; // namespace detail
+
+/* Sorts `keys` and drops repeats, with up to `threads` threads: a parallel
+ * radix sort for integral keys, a parallel merge sort for the rest. */
+template <typename T>
+inline void sort_unique(std::vector<T> &keys, unsigned threads)
+{
+    threads = std::max(1u, threads);
+
+    if constexpr (std::is_integral_v<T>)
+        detail::radix_sort(keys, threads);
+    else
+        detail::merge_sort(keys, threads);
+
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+}; // namespace range_queries
+
+#endif // RADIX_SORT_H
@@ -1,72 +1,733 @@
 #ifndef RANGE_QUERIES_H
 #define RANGE_QUERIES_H
 
-#include <iostream> // for char_traits, basic_istream, basic_ostream, oper...
-#include <stddef.h> // for size_t
+#include <array>        // for array
+#include <charconv>     // for from_chars, to_chars
+#include <chrono>       // for steady_clock, duration
+#include <cmath>        // for ceil, isnan
+#include <concepts>     // for convertible_to, same_as
+#include <exception>    // for exception_ptr, current_exception, rethrow_exception
+#include <iostream>     // for char_traits, basic_istream, basic_ostream, oper...
+#include <iterator>     // for distance, next
+#include <optional>     // for optional, nullopt
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t
+#include <string>       // for string
+#include <system_error> // for errc
+#include <thread>       // for thread
+#include <type_traits>  // for is_floating_point_v
+#include <vector>       // for vector
 
-#include "RB_Tree.h" // for RB_Tree
+#include "RB_Tree.h"    // for RB_Tree
+#include "Range_Tree.h" // for Dynamic_Tree
 #include "log.h"
+#include "pipeline.h"    // for Spsc_Ring, Stage_Stats
+#include "profiler.h"    // for Profiler
+#include "query_cache.h" // for Cached, Cache_Stats
+#include "radix_sort.h"  // for sort_unique
+#include "window.h"      // for Windowed, Erases_Keys
 
 namespace range_queries
 {
 
-template <typename Tree, typename T>
-inline void start(std::istream &in, std::ostream &out)
+template <typename T>
+struct Command
 {
-    Tree tree;
     char option = 0;
+    T first{};
+    T second{};
+    T third{};        // r
+    T fourth{};       // r
+    size_t count = 0; // w, s
+    double real = 0;  // t, f
+};
+
+inline void print_usage()
+{
+    std::cerr << "Invalid option.\n"
+              << "Usage:\n"
+              << "\tk key_value\n"
+              << "\tq left_boundary right_right_boundary\n"
+              << "\tw inserts (count only keys of the last inserts, 0 - no limit)\n"
+              << "\tt seconds (count only keys of the last seconds, 0 - no limit)\n"
+              << "\ts k (print the k-th smallest key, from 1)\n"
+              << "\tn key (print how many keys are less than key)\n"
+              << "\tf fraction (print the nearest-rank quantile, 0 <= fraction <= 1)\n"
+              << "\tp x y (insert a point)\n"
+              << "\tr x1 y1 x2 y2 (count points in the rectangle)\n";
+}
+
+/* Reads a key. Floating keys go through from_chars, which unlike operator>>
+ * also takes nan and inf; like operator>>, a malformed key is left unread
+ * where the stream can seek back. */
+template <typename T>
+inline std::istream &read_key(std::istream &in, T &key)
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        std::istream::pos_type start = in.tellg();
+
+        std::string token;
+        if (!(in >> token))
+            return in;
+
+        const char *first = token.data();
+        const char *last = first + token.size();
+        if (token.size() > 1 && *first == '+' && first[1] != '-')
+            ++first;
+
+        auto [end, error] = std::from_chars(first, last, key);
+        if (error != std::errc{} || end != last)
+        {
+            if (start != std::istream::pos_type(-1))
+                in.seekg(start);
+            in.setstate(std::ios::failbit);
+        }
 
-    while (in >> option)
+        return in;
+    }
+    else
+        return in >> key;
+}
+
+/* Writes a key. Floating keys are written in the shortest form that reads
+ * back as the same value, so printed keys can be fed back as input. */
+template <typename T>
+inline std::ostream &write_key(std::ostream &out, const T &key)
+{
+    if constexpr (std::is_floating_point_v<T>)
     {
-        switch (option)
+        char text[64];
+        auto [end, error] = std::to_chars(text, text + sizeof(text), key);
+        return out.write(text, end - text);
+    }
+    else
+        return out << key;
+}
+
+/* Reads the next command, skipping unknown options. Returns false once the
+ * input is exhausted or ends in the middle of a command. */
+template <typename T>
+inline bool read_command(std::istream &in, Command<T> &command)
+{
+    while (in >> command.option)
+    {
+        switch (command.option)
         {
             case 'k':
+                return static_cast<bool>(read_key(in, command.first));
+            case 'q':
+                return static_cast<bool>(read_key(read_key(in, command.first),
+                                                  command.second));
+            case 'w':
+                return static_cast<bool>(in >> command.count);
+            case 't':
+            case 'f':
+                return static_cast<bool>(in >> command.real);
+            case 's':
+                return static_cast<bool>(in >> command.count);
+            case 'n':
+                return static_cast<bool>(read_key(in, command.first));
+            case 'p':
+                return static_cast<bool>(read_key(read_key(in, command.first),
+                                                  command.second));
+            case 'r':
+                for (T *key : {&command.first, &command.second, &command.third,
+                               &command.fourth})
+                    if (!read_key(in, *key))
+                        return false;
+                return true;
+            default:
+                print_usage();
+        }
+    }
+
+    return false;
+}
+
+/* NaN compares false against every key, so no engine can place it: NaN
+ * keys are not inserted, and ranges bounded by NaN hold nothing. */
+template <typename T>
+inline bool is_unordered(const T &key)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return std::isnan(key);
+    else
+        return false;
+}
+
+/* Engines that answer range counts faster than an iterator walk. */
+template <typename Tree, typename T>
+concept Counts_Ranges = requires(Tree &tree, const T &key) {
+    { tree.range_count(key, key) } -> std::convertible_to<size_t>;
+};
+
+template <typename Tree, typename T>
+inline size_t range_count(Tree &tree, const T &left_b, const T &right_b)
+{
+    LOG("query from {} to {}\n", left_b, right_b);
+
+    if (!(left_b <= right_b)) // also NaN bounds
+        return 0;
+
+    if constexpr (Counts_Ranges<Tree, T>)
+        return tree.range_count(left_b, right_b);
+    else
+    {
+        auto lower_b = tree.lower_bound(left_b);
+        auto upper_b = tree.upper_bound(right_b);
+
+        return static_cast<size_t>(std::distance(lower_b, upper_b));
+    }
+}
+
+/* Engines answering order statistics through subtree counts rather than
+ * an iterator walk from the smallest key. */
+template <typename Tree, typename T>
+concept Ranks_Keys = requires(Tree &tree, const T &key) {
+    { tree.rank(key) } -> std::convertible_to<size_t>;
+    tree.select(size_t{});
+};
+
+/* Number of keys less than `key`, or nullopt if the engine can't tell. */
+template <typename Tree, typename T>
+inline std::optional<size_t> rank(Tree &tree, const T &key)
+{
+    if constexpr (Ranks_Keys<Tree, T>)
+        return tree.rank(key);
+    else if constexpr (requires { tree.begin(); tree.lower_bound(key); })
+        return static_cast<size_t>(std::distance(tree.begin(), tree.lower_bound(key)));
+    else
+        return std::nullopt;
+}
+
+/* The key with `index` smaller keys, if there is one. */
+template <typename Tree, typename T>
+inline std::optional<T> select(Tree &tree, size_t index)
+{
+    if constexpr (Ranks_Keys<Tree, T>)
+    {
+        if constexpr (std::same_as<decltype(tree.select(index)), std::optional<T>>)
+            return tree.select(index);
+        else
+        {
+            auto found = tree.select(index);
+            if (found == tree.end())
+                return std::nullopt;
+            return *found;
+        }
+    }
+    else if constexpr (requires { tree.begin(); tree.size(); })
+    {
+        if (index >= tree.size())
+            return std::nullopt;
+        return *std::next(tree.begin(), static_cast<std::ptrdiff_t>(index));
+    }
+    else
+        return std::nullopt;
+}
+
+/* Nearest-rank quantile: the smallest key with at least `fraction` of all
+ * keys not after it. */
+template <typename Tree, typename T>
+inline std::optional<T> quantile(Tree &tree, double fraction)
+{
+    if constexpr (!requires { tree.size(); })
+        return std::nullopt;
+    else
+    {
+        if (!(fraction >= 0.0 && fraction <= 1.0) || tree.size() == 0)
+            return std::nullopt;
+
+        double position = std::ceil(fraction * static_cast<double>(tree.size()));
+        size_t index = position < 1 ? 0 : static_cast<size_t>(position) - 1;
+
+        return select<Tree, T>(tree, index < tree.size() ? index : tree.size() - 1);
+    }
+}
+
+/* Windowed engines drop aged keys before answering. */
+template <typename Tree>
+inline void expire_keys(Tree &tree)
+{
+    if constexpr (requires { tree.expire(); })
+        tree.expire();
+}
+
+/* What a command prints: a count, a key, or `none` for a missing key. */
+template <typename T>
+struct Answer
+{
+    enum class Kind : char
+    {
+        count,
+        key,
+        none
+    };
+
+    Kind kind = Kind::none;
+    size_t count = 0;
+    T key{};
+
+    static Answer of_count(size_t value) { return {Kind::count, value, T{}}; }
+
+    template <typename Value>
+    static Answer of(const std::optional<Value> &value)
+    {
+        if (!value)
+            return {};
+
+        if constexpr (std::same_as<Value, T>)
+            return {Kind::key, 0, *value};
+        else
+            return of_count(*value);
+    }
+};
+
+template <typename T>
+inline void print_answer(std::ostream &out, const Answer<T> &answer)
+{
+    switch (answer.kind)
+    {
+        case Answer<T>::Kind::count:
+            out << answer.count << ' ';
+            break;
+        case Answer<T>::Kind::key:
+            write_key(out, answer.key) << ' ';
+            break;
+        case Answer<T>::Kind::none:
+        default:
+            out << "none ";
+    }
+}
+
+/* Runs a command against the engine; returns what it prints, if anything.
+ * Keeping formatting apart lets the pipelined driver do it elsewhere. */
+template <typename Tree, typename T>
+inline std::optional<Answer<T>> apply(Tree &tree, const Command<T> &command)
+{
+    switch (command.option)
+    {
+        case 'k':
+            if (is_unordered(command.first))
+                std::cerr << "NaN keys are not stored\n";
+            else
+                tree.insert(command.first);
+            break;
+        case 'q':
+            expire_keys(tree);
+            return Answer<T>::of_count(range_count(tree, command.first, command.second));
+        case 's':
+            expire_keys(tree);
+            return Answer<T>::of(command.count == 0
+                                     ? std::nullopt
+                                     : select<Tree, T>(tree, command.count - 1));
+        case 'n':
+            expire_keys(tree);
+            return Answer<T>::of(rank(tree, command.first));
+        case 'f':
+            expire_keys(tree);
+            return Answer<T>::of(quantile<Tree, T>(tree, command.real));
+        case 'w':
+            if constexpr (requires { tree.set_max_inserts(command.count); })
+                tree.set_max_inserts(command.count);
+            else
+                std::cerr << "This engine can't expire keys\n";
+            break;
+        case 't':
+            if constexpr (requires { tree.set_max_age(command.real); })
+                tree.set_max_age(command.real);
+            else
+                std::cerr << "This engine can't expire keys\n";
+            break;
+        default:
+            print_usage();
+    }
+
+    return std::nullopt;
+}
+
+/* Same as above, plus the 2D commands, which go to `plane`. */
+template <typename Tree, typename Plane, typename T>
+inline std::optional<Answer<T>> apply(Tree &tree, Plane &plane, const Command<T> &command)
+{
+    switch (command.option)
+    {
+        case 'p':
+            if (is_unordered(command.first) || is_unordered(command.second))
+                std::cerr << "NaN coordinates are not stored\n";
+            else
+                plane.insert(command.first, command.second);
+            return std::nullopt;
+        case 'r':
+            if (is_unordered(command.first) || is_unordered(command.second) ||
+                is_unordered(command.third) || is_unordered(command.fourth))
+                return Answer<T>::of_count(0);
+            return Answer<T>::of_count(plane.count(command.first, command.second,
+                                                   command.third, command.fourth));
+        default:
+            return apply(tree, command);
+    }
+}
+
+/* Same as above, timed into `profiler` unless it is null. */
+template <typename Tree, typename Plane, typename T>
+inline std::optional<Answer<T>> apply(Tree &tree, Plane &plane, const Command<T> &command,
+                                      Profiler *profiler)
+{
+    if (profiler == nullptr)
+        return apply(tree, plane, command);
+
+    uint64_t began = Profiler::now();
+    std::optional<Answer<T>> answer = apply(tree, plane, command);
+
+    profiler->record(command.option,
+                     command.option == 'q'
+                         ? Profiler::width_bucket(command.first, command.second)
+                         : 0,
+                     began);
+    return answer;
+}
+
+template <typename Tree, typename T>
+inline void execute(Tree &tree, const Command<T> &command, std::ostream &out)
+{
+    if (auto answer = apply(tree, command))
+        print_answer(out, *answer);
+}
+
+template <typename Tree, typename Plane, typename T>
+inline void execute(Tree &tree, Plane &plane, const Command<T> &command,
+                    std::ostream &out)
+{
+    if (auto answer = apply(tree, plane, command))
+        print_answer(out, *answer);
+}
+
+/* Runs of at least this many 'k' commands are inserted as one batch. */
+constexpr size_t burst_min_keys = 1024;
+
+template <typename Tree, typename T>
+concept Inserts_Sorted = requires(Tree &tree, std::vector<T> &keys) {
+    tree.insert_sorted(keys.begin(), keys.end());
+};
+
+/* Collects runs of 'k' commands for engines that insert sorted batches.
+ * Nothing reads the engine in the middle of a run, so inserting its keys
+ * in another order changes no answer: a long run is sorted and deduplicated
+ * by all cores and goes in with one insert_sorted(). Windows need keys in
+ * arrival order, so runs are left alone while one is set. A profiler gets
+ * the time of a flush split evenly over the keys of the run. */
+template <typename Tree, typename T>
+class Burst_Ingest
+{
+  private:
+    Tree &tree_;
+    std::vector<T> keys_;
+    Profiler *profiler_;
+    unsigned threads_;
+
+    bool takes_bursts() const
+    {
+        if constexpr (requires { tree_.expiring(); })
+            return !tree_.expiring();
+        else
+            return true;
+    }
+
+  public:
+    explicit Burst_Ingest(Tree &tree, Profiler *profiler = nullptr,
+                          unsigned threads = std::thread::hardware_concurrency())
+        : tree_(tree)
+        , profiler_(profiler)
+        , threads_(threads)
+    {}
+
+    Burst_Ingest(const Burst_Ingest &) = delete;
+    Burst_Ingest &operator=(const Burst_Ingest &) = delete;
+
+    /* Takes `command` if it extends a run; the caller applies it otherwise,
+     * after flush(). */
+    bool add(const Command<T> &command)
+    {
+        if constexpr (Inserts_Sorted<Tree, T>)
+        {
+            if (command.option != 'k' || is_unordered(command.first) ||
+                !takes_bursts())
+                return false;
+
+            keys_.push_back(command.first);
+            return true;
+        }
+        else
+            return false;
+    }
+
+    /* Inserts the run collected so far. */
+    void flush()
+    {
+        if (keys_.empty())
+            return;
+
+        uint64_t began = profiler_ != nullptr ? Profiler::now() : 0;
+        size_t commands = keys_.size(); // before repeats are dropped
+
+        if constexpr (Inserts_Sorted<Tree, T>)
+        {
+            if (keys_.size() < burst_min_keys)
+                for (const T &key : keys_)
+                    tree_.insert(key);
+            else
             {
-                T key = 0;
-                in >> key;
+                sort_unique(keys_, threads_);
+                tree_.insert_sorted(keys_.begin(), keys_.end());
+            }
+        }
+
+        if (profiler_ != nullptr)
+            profiler_->record('k', 0, began, commands);
+
+        keys_.clear();
+    }
+};
+
+/* `in` is an istream, or any source with a read_command() overload, such
+ * as command_file::Reader. Commands are timed into `profiler` unless it is
+ * null. */
+template <typename Tree, typename T, typename Input>
+inline void run_commands(Input &in, std::ostream &out, Tree &tree,
+                         Profiler *profiler = nullptr)
+{
+    Command<T> command;
+    Range::Dynamic_Tree<T> plane;
+    Burst_Ingest<Tree, T> burst(tree, profiler);
+
+    while (read_command(in, command))
+    {
+        if (burst.add(command))
+            continue;
+
+        burst.flush();
+        if (auto answer = apply(tree, plane, command, profiler))
+            print_answer(out, *answer);
+    }
+
+    burst.flush();
+}
+
+/* Commands per batch handed between pipeline stages, and batches each
+ * queue holds. */
+constexpr size_t pipeline_batch = 4096;
+constexpr size_t pipeline_depth = 16;
+
+/* Same as run_commands, in three stages: a parser thread reads batches of
+ * commands, an engine thread applies them, and the calling thread formats
+ * the answers. Each stage keeps its own data hot in its core's cache; the
+ * output is identical. Returns what each stage did. */
+template <typename Tree, typename T, typename Input>
+inline std::array<Stage_Stats, 3> run_pipelined(Input &in, std::ostream &out,
+                                                Tree &tree,
+                                                Profiler *profiler = nullptr)
+{
+    using Commands = std::vector<Command<T>>;
+    using Answers = std::vector<Answer<T>>;
+    using clock = std::chrono::steady_clock;
+
+    Spsc_Ring<Commands> commands(pipeline_depth);
+    Spsc_Ring<Answers> answers(pipeline_depth);
+
+    std::array<Stage_Stats, 3> stats;
+    stats[0].name = "parse";
+    stats[1].name = "engine";
+    stats[2].name = "format";
+
+    std::array<std::exception_ptr, 3> errors;
+
+    auto seconds_since = [](clock::time_point start)
+    { return std::chrono::duration<double>(clock::now() - start).count(); };
+
+    std::thread parser(
+        [&]
+        {
+            auto start = clock::now();
+
+            try
+            {
+                Commands batch;
+                Command<T> command;
+                bool more = true;
+
+                while (more)
+                {
+                    batch.clear();
+                    batch.reserve(pipeline_batch);
 
-                tree.insert(key);
+                    while (batch.size() < pipeline_batch &&
+                           (more = read_command(in, command)))
+                        batch.push_back(command);
 
-                break;
+                    if (batch.empty())
+                        break;
+
+                    stats[0].items += batch.size();
+                    ++stats[0].batches;
+
+                    if (!commands.push(batch, stats[0].stalled))
+                        break;
+                }
             }
-            case 'q':
+            catch (...)
             {
-                T left_b{};
-                T right_b{};
+                errors[0] = std::current_exception();
+            }
+
+            commands.close();
+            stats[0].seconds = seconds_since(start);
+        });
 
-                in >> left_b >> right_b;
-                LOG("query from {} to {}\n", left_b, right_b);
+    std::thread engine(
+        [&]
+        {
+            auto start = clock::now();
 
-                if (left_b > right_b)
+            try
+            {
+                Range::Dynamic_Tree<T> plane;
+                Burst_Ingest<Tree, T> burst(tree, profiler);
+                Commands batch;
+                Answers result;
+
+                while (commands.pop(batch, stats[1].stalled))
                 {
-                    out << 0 << ' ';
-                    break;
-                }
+                    result.clear();
+                    result.reserve(batch.size());
 
-                auto lower_b = tree.lower_bound(left_b);
-                auto upper_b = tree.upper_bound(right_b);
+                    for (const Command<T> &command : batch)
+                    {
+                        if (burst.add(command))
+                            continue;
 
-                auto distance = std::distance(lower_b, upper_b);
+                        burst.flush();
+                        if (auto answer = apply(tree, plane, command, profiler))
+                            result.push_back(*answer);
+                    }
 
-                out << distance << ' ';
+                    stats[1].items += batch.size();
+                    ++stats[1].batches;
 
-                break;
+                    if (!answers.push(result, stats[1].stalled))
+                        break;
+                }
+
+                burst.flush();
             }
-            default:
-                std::cerr << "Invalid option.\n"
-                          << "Usage:\n"
-                          << "\tk key_value\n"
-                          << "\tq left_boundary right_right_boundary\n";
+            catch (...)
+            {
+                errors[1] = std::current_exception();
+            }
+
+            /* Stops the parser early if this stage or the formatter gave up. */
+            commands.close();
+            answers.close();
+            stats[1].seconds = seconds_since(start);
+        });
+
+    auto start = clock::now();
+
+    try
+    {
+        Answers result;
+
+        while (answers.pop(result, stats[2].stalled))
+        {
+            for (const Answer<T> &answer : result)
+                print_answer(out, answer);
+
+            stats[2].items += result.size();
+            ++stats[2].batches;
         }
     }
+    catch (...)
+    {
+        errors[2] = std::current_exception();
+        answers.close();
+    }
+
+    stats[2].seconds = seconds_since(start);
+
+    parser.join();
+    engine.join();
+
+    for (const std::exception_ptr &error : errors)
+        if (error)
+            std::rethrow_exception(error);
+
+    return stats;
+}
+
+template <typename Tree, typename T, typename Input>
+inline void run_input(Input &in, std::ostream &out, Tree &tree, bool pipelined,
+                      Profiler *profiler)
+{
+    if (!pipelined)
+    {
+        run_commands<Tree, T>(in, out, tree, profiler);
+        return;
+    }
+
+    for (const Stage_Stats &stats : run_pipelined<Tree, T>(in, out, tree, profiler))
+        std::cerr << stats << '\n';
+}
+
+/* With `cache_entries`, range counts are memoized in front of the engine
+ * and the hit rate goes to stderr at the end. */
+template <typename Tree, typename T, typename Input>
+inline void run_engine(Input &in, std::ostream &out, Tree &tree, bool pipelined,
+                       size_t cache_entries, Profiler *profiler)
+{
+    if (cache_entries == 0)
+    {
+        run_input<Tree, T>(in, out, tree, pipelined, profiler);
+        return;
+    }
+
+    Cached<Tree, T> cached(tree, cache_entries);
+    run_input<Cached<Tree, T>, T>(in, out, cached, pipelined, profiler);
+
+    std::cerr << cached.stats() << '\n';
+}
+
+/* With a `profiler`, every command is timed into it; the caller reports. */
+template <typename Tree, typename T, typename Input>
+inline void start(Input &in, std::ostream &out, Tree &tree, bool pipelined = false,
+                  size_t cache_entries = 0, Profiler *profiler = nullptr)
+{
+    if constexpr (Erases_Keys<Tree, T>)
+    {
+        Windowed<Tree, T> windowed(tree);
+        run_engine<Windowed<Tree, T>, T>(in, out, windowed, pipelined, cache_entries,
+                                         profiler);
+    }
+    else
+        run_engine<Tree, T>(in, out, tree, pipelined, cache_entries, profiler);
 
     out << std::endl;
 
 #ifdef DUMP_TREE
-    tree.dump();
+    if constexpr (requires { tree.dump(); })
+        tree.dump();
 #endif // DUMP_TREE
 }
 
+template <typename Tree, typename T, typename Input>
+inline void start(Input &in, std::ostream &out, bool pipelined = false,
+                  size_t cache_entries = 0, Profiler *profiler = nullptr)
+{
+    Tree tree;
+
+    start<Tree, T>(in, out, tree, pipelined, cache_entries, profiler);
+}
+
 }; // namespace range_queries
 
 #endif
@@ -0,0 +1,503 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#ifdef __linux__
+
+#include <errno.h>      // for errno
+#include <fcntl.h>      // for fcntl, O_NONBLOCK
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t
+#include <sys/epoll.h>  // for epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h> // for accept4, recv
+#include <unistd.h>     // for close, unlink
+
+#include <atomic>        // for atomic
+#include <chrono>        // for steady_clock, duration_cast, nanoseconds
+#include <cstring>       // for memcpy
+#include <iostream>      // for cerr, ostream
+#include <memory>        // for unique_ptr, make_unique
+#include <mutex>         // for mutex, lock_guard, unique_lock
+#include <shared_mutex>  // for shared_mutex, shared_lock
+#include <istream>       // for istream
+#include <sstream>       // for ostringstream
+#include <streambuf>     // for streambuf
+#include <string>        // for string, to_string
+#include <unordered_map> // for unordered_map
+
+#include "histogram.h"     // for Latency_Histogram, print_latency
+#include "log.h"           // for LOG, MSG
+#include "net.h"           // for Address, listen_on, send_all
+#include "range_queries.h" // for Command, read_command, execute
+#include "thread_pool.h"   // for Thread_Pool
+
+namespace range_queries
+{
+
+namespace server
+{
+
+/* A connection that starts with this byte speaks the binary protocol:
+ * pipelined frames of `'k' key` or `'q' left right` with native-endian
+ * keys, answered by one native-endian uint64_t count per query. Any other
+ * first byte selects the text protocol of range_queries::start. */
+static constexpr char binary_magic = '\xB1';
+
+namespace detail
+{
+
+/* Reads a range of a buffer in place, with the seeking that read_command
+ * and read_key rely on. */
+class Input_View : public std::streambuf
+{
+  public:
+    Input_View(char *first, char *last) { setg(first, first, last); }
+
+  protected:
+    /* pos_type holds a tiny array, which -fstack-protector skips and
+     * -Wstack-protector then reports; these are protected outright. */
+    [[gnu::stack_protect]] pos_type seekoff(off_type offset,
+                                            std::ios_base::seekdir direction,
+                                            std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        char *base = direction == std::ios_base::beg   ? eback()
+                     : direction == std::ios_base::cur ? gptr()
+                                                       : egptr();
+
+        if (offset < eback() - base || offset > egptr() - base)
+            return pos_type(off_type(-1));
+
+        setg(eback(), base + offset, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    [[gnu::stack_protect]] pos_type seekpos(pos_type position,
+                                            std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+};
+
+}; // namespace detail
+
+struct Server_Options
+{
+    net::Address address;
+    size_t threads = 1;
+    bool session_trees = false;
+};
+
+/* Serves the k/q protocols over a local socket. An epoll loop watches the
+ * sockets and hands every readable session to a worker of the thread pool.
+ * Sessions are registered with EPOLLONESHOT, so a session is handled by one
+ * worker at a time and its commands are answered in order. A worker reads at
+ * most reads_per_turn_ chunks before answering them and re-arming the
+ * session, so a client that keeps streaming neither holds a worker nor
+ * grows its buffer; one that sends more than max_input_ bytes without a
+ * complete command is closed. Sessions either share one tree guarded by a
+ * reader-writer lock or own a private tree. */
+template <typename Tree, typename T>
+class Server
+{
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t read_chunk_ = 1 << 16;
+    static constexpr size_t reads_per_turn_ = 4;
+    static constexpr size_t max_input_ = 16 * read_chunk_;
+    static constexpr int max_events_ = 64;
+    static constexpr int wait_ms_ = 100;
+
+    enum class Protocol
+    {
+        unknown,
+        text,
+        binary
+    };
+
+    struct Session
+    {
+        int fd = -1;
+        size_t id = 0;
+        Protocol protocol = Protocol::unknown;
+        std::string input;
+        std::string output;
+        std::unique_ptr<Tree> tree;
+        Latency_Histogram latency;
+    };
+
+    Server_Options options_;
+
+    Tree &shared_tree_;
+    std::shared_mutex tree_mutex_;
+
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+
+    std::mutex sessions_mutex_;
+    std::unordered_map<Session *, std::unique_ptr<Session>> sessions_;
+    size_t next_id_ = 0;
+
+    std::mutex report_mutex_;
+    Latency_Histogram total_latency_;
+
+    std::unique_ptr<Thread_Pool> pool_;
+
+    static uint64_t nanos_since(clock::time_point start)
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start)
+                .count());
+    }
+
+    void watch(Session &session, int operation)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.ptr = &session;
+
+        if (::epoll_ctl(epoll_fd_, operation, session.fd, &event) != 0)
+            net::detail::throw_errno("epoll_ctl failed");
+    }
+
+    void accept_all()
+    {
+        while (true)
+        {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    std::cerr << "accept failed: " << std::strerror(errno) << '\n';
+                return;
+            }
+
+            auto session = std::make_unique<Session>();
+            session->fd = fd;
+
+            if (options_.session_trees)
+                session->tree = std::make_unique<Tree>();
+
+            Session &registered = *session;
+
+            {
+                std::lock_guard lock(sessions_mutex_);
+                session->id = next_id_++;
+                sessions_.emplace(session.get(), std::move(session));
+            }
+
+            LOG("session {} connected\n", registered.id);
+
+            watch(registered, EPOLL_CTL_ADD);
+        }
+    }
+
+    template <typename Function>
+    auto with_tree(Session &session, bool modifies, Function function)
+    {
+        if (session.tree)
+            return function(*session.tree);
+
+        if (modifies)
+        {
+            std::unique_lock lock(tree_mutex_);
+            return function(shared_tree_);
+        }
+
+        std::shared_lock lock(tree_mutex_);
+        return function(shared_tree_);
+    }
+
+    void process_text(Session &session, clock::time_point arrived, bool at_eof)
+    {
+        size_t complete = session.input.size();
+
+        if (!at_eof)
+        {
+            complete = session.input.find_last_of(" \t\n\v\f\r");
+            if (complete == std::string::npos)
+                return;
+            ++complete;
+        }
+
+        detail::Input_View view(session.input.data(), session.input.data() + complete);
+        std::istream in(&view);
+        std::ostringstream out;
+
+        Command<T> command;
+        size_t consumed = complete;
+
+        while (true)
+        {
+            std::streampos position = in.tellg();
+
+            if (!read_command(in, command))
+            {
+                if (in.eof())
+                {
+                    /* Keep a command cut in half by the read boundary. */
+                    if (!at_eof && position != std::streampos(-1))
+                        consumed = static_cast<size_t>(position);
+                    break;
+                }
+
+                /* Report the command and go on after its bad argument. */
+                out << "error: bad argument to '" << command.option << "'\n";
+
+                std::string bad;
+                in.clear();
+                in >> bad;
+                continue;
+            }
+
+            with_tree(session, command.option == 'k',
+                      [&](Tree &tree)
+                      {
+                          execute(tree, command, out);
+                          return 0;
+                      });
+
+            session.latency.record(nanos_since(arrived));
+        }
+
+        session.input.erase(0, consumed);
+        session.output += out.str();
+    }
+
+    bool process_binary(Session &session, clock::time_point arrived)
+    {
+        size_t offset = 0;
+
+        while (offset < session.input.size())
+        {
+            char option = session.input[offset];
+            size_t frame = option == 'k'   ? 1 + sizeof(T)
+                           : option == 'q' ? 1 + 2 * sizeof(T)
+                                           : 0;
+
+            if (frame == 0)
+            {
+                std::cerr << "session " << session.id
+                          << ": invalid binary option, closing\n";
+                return false;
+            }
+
+            if (session.input.size() - offset < frame)
+                break;
+
+            Command<T> command;
+            command.option = option;
+            std::memcpy(&command.first, session.input.data() + offset + 1, sizeof(T));
+
+            if (option == 'k')
+                with_tree(session, true,
+                          [&](Tree &tree)
+                          {
+                              if (!is_unordered(command.first))
+                                  tree.insert(command.first);
+                              return 0;
+                          });
+            else
+            {
+                std::memcpy(&command.second,
+                            session.input.data() + offset + 1 + sizeof(T), sizeof(T));
+
+                uint64_t count = with_tree(session, false,
+                    [&](Tree &tree)
+                    {
+                        return static_cast<uint64_t>(
+                            range_count(tree, command.first, command.second));
+                    });
+
+                session.output.append(reinterpret_cast<const char *>(&count),
+                                      sizeof(count));
+            }
+
+            session.latency.record(nanos_since(arrived));
+            offset += frame;
+        }
+
+        session.input.erase(0, offset);
+
+        return true;
+    }
+
+    void close_session(Session &session)
+    {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, session.fd, nullptr);
+        ::close(session.fd);
+
+        {
+            std::lock_guard lock(report_mutex_);
+
+            print_latency(std::cerr, "session " + std::to_string(session.id),
+                          session.latency);
+            total_latency_.merge(session.latency);
+        }
+
+        std::lock_guard lock(sessions_mutex_);
+        sessions_.erase(&session);
+    }
+
+    void serve(Session &session)
+    {
+        bool closing = false;
+
+        for (size_t reads = 0; reads < reads_per_turn_;)
+        {
+            size_t old_size = session.input.size();
+            session.input.resize(old_size + read_chunk_);
+
+            ssize_t received = ::recv(session.fd, session.input.data() + old_size,
+                                      read_chunk_, 0);
+
+            session.input.resize(old_size + (received > 0 ? static_cast<size_t>(received) : 0));
+
+            if (received > 0)
+            {
+                ++reads;
+                continue;
+            }
+
+            if (received < 0 && errno == EINTR)
+                continue;
+
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                closing = true;
+
+            break;
+        }
+
+        clock::time_point arrived = clock::now();
+
+        if (session.protocol == Protocol::unknown && !session.input.empty())
+        {
+            if (session.input.front() == binary_magic)
+            {
+                session.protocol = Protocol::binary;
+                session.input.erase(0, 1);
+            }
+            else
+                session.protocol = Protocol::text;
+        }
+
+        if (session.protocol == Protocol::text)
+            process_text(session, arrived, closing);
+        else if (session.protocol == Protocol::binary &&
+                 !process_binary(session, arrived))
+            closing = true;
+
+        if (session.input.size() > max_input_)
+        {
+            std::cerr << "session " << session.id
+                      << ": command longer than the input limit, closing\n";
+            closing = true;
+        }
+
+        if (!session.output.empty())
+        {
+            if (!net::send_all(session.fd, session.output.data(),
+                               session.output.size()))
+                closing = true;
+
+            session.output.clear();
+        }
+
+        if (closing)
+            close_session(session);
+        else
+            watch(session, EPOLL_CTL_MOD);
+    }
+
+  public:
+    Server(const Server_Options &options, Tree &shared_tree)
+        : options_(options)
+        , shared_tree_(shared_tree)
+    {
+        listen_fd_ = net::listen_on(options_.address);
+
+        int flags = ::fcntl(listen_fd_, F_GETFL, 0);
+        ::fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK);
+
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0)
+        {
+            ::close(listen_fd_);
+            net::detail::throw_errno("epoll_create1 failed");
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event) != 0)
+        {
+            ::close(epoll_fd_);
+            ::close(listen_fd_);
+            net::detail::throw_errno("epoll_ctl failed");
+        }
+    }
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    ~Server()
+    {
+        ::close(epoll_fd_);
+        ::close(listen_fd_);
+
+        if (options_.address.is_unix)
+            ::unlink(options_.address.path.c_str());
+    }
+
+    /* Runs the event loop until `stop` is raised, then drains in-flight work,
+     * closes the remaining sessions and prints the overall latency. */
+    void run(const std::atomic<bool> &stop)
+    {
+        pool_ = std::make_unique<Thread_Pool>(options_.threads);
+
+        epoll_event events[max_events_];
+
+        while (!stop.load())
+        {
+            int ready = ::epoll_wait(epoll_fd_, events, max_events_, wait_ms_);
+
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                net::detail::throw_errno("epoll_wait failed");
+            }
+
+            for (int id = 0; id < ready; ++id)
+            {
+                Session *session = static_cast<Session *>(events[id].data.ptr);
+
+                if (session == nullptr)
+                    accept_all();
+                else
+                    pool_->submit([this, session] { serve(*session); });
+            }
+        }
+
+        pool_.reset();
+
+        while (!sessions_.empty())
+            close_session(*sessions_.begin()->second);
+
+        print_latency(std::cerr, "total", total_latency_);
+    }
+};
+
+}; // namespace server
+
+}; // namespace range_queries
+
+#endif // __linux__
+
+#endif // SERVER_H
@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h> // for size_t
+
+#include <functional> // for function
+#include <mutex>      // for mutex, lock_guard
+#include <queue>      // for queue
+#include <semaphore>  // for counting_semaphore
+#include <thread>     // for thread
+#include <utility>    // for move
+#include <vector>     // for vector
+
+namespace range_queries
+{
+
+/* Fixed set of workers draining a FIFO of tasks. The semaphore counts
+ * submitted tasks plus one stop token per worker, so the destructor runs
+ * every task that was already submitted before joining. */
+class Thread_Pool
+{
+  private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::counting_semaphore<> available_{0};
+
+    void work()
+    {
+        while (true)
+        {
+            available_.acquire();
+
+            std::function<void()> task;
+
+            {
+                std::lock_guard lock(mutex_);
+
+                if (tasks_.empty())
+                    return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+
+            task();
+        }
+    }
+
+  public:
+    explicit Thread_Pool(size_t threads)
+    {
+        if (threads == 0)
+            threads = 1;
+
+        for (size_t id = 0; id < threads; ++id)
+            workers_.emplace_back([this] { work(); });
+    }
+
+    Thread_Pool(const Thread_Pool &) = delete;
+    Thread_Pool &operator=(const Thread_Pool &) = delete;
+
+    ~Thread_Pool()
+    {
+        available_.release(static_cast<std::ptrdiff_t>(workers_.size()));
+
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+
+        available_.release();
+    }
+
+    size_t size() const { return workers_.size(); }
+};
+
+}; // namespace range_queries
+
+#endif // THREAD_POOL_H
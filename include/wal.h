@@ -0,0 +1,566 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <errno.h>  // for errno
+#include <fcntl.h>  // for open, O_WRONLY, O_CREAT
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint32_t, uint64_t
+#include <unistd.h> // for write, fsync, ftruncate, close
+
+#include <chrono>             // for steady_clock, milliseconds
+#include <condition_variable> // for condition_variable
+#include <cstdio>             // for rename
+#include <cstring>            // for memcmp, memcpy
+#include <exception>          // for exception_ptr, current_exception, rethrow_exception
+#include <filesystem>         // for path, exists, create_directories
+#include <iostream>           // for cerr
+#include <mutex>              // for mutex, lock_guard, unique_lock
+#include <stdexcept>          // for runtime_error
+#include <string>             // for string
+#include <system_error>       // for system_error, generic_category
+#include <thread>             // for thread
+#include <type_traits>        // for is_trivially_copyable_v
+#include <utility>            // for exchange
+#include <vector>             // for vector
+
+#include "log.h"
+#include "snapshot.h" // for Checksum, Mapped_File
+
+namespace range_queries
+{
+
+/* When buffered inserts are written and fsync'ed as one group commit.
+ * Whichever limit is hit first triggers the commit; zero disables a limit.
+ * The time limit is kept by a background thread, so it also holds while no
+ * commands arrive. */
+struct Sync_Policy
+{
+    size_t every_ops = 64;
+    std::chrono::milliseconds every_ms{10};
+    size_t checkpoint_ops = 1 << 20;
+};
+
+namespace detail
+{
+
+struct Wal_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t key_type;
+    uint32_t reserved;
+};
+
+struct Frame_Header
+{
+    uint32_t count;
+    uint32_t flags;
+    uint64_t checksum;
+};
+
+/* The keys are followed by a bitmap, bit i set if key i was erased. */
+static constexpr uint32_t frame_has_erases = 1;
+
+static constexpr char wal_magic[8] = {'R', 'B', 'W', 'A', 'L', '\0', '\0', '\0'};
+static constexpr uint32_t wal_version = 2;
+
+inline void throw_errno(const std::string &what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+inline void write_all(int fd, const void *data, size_t size,
+                      const std::string &path)
+{
+    const char *bytes = static_cast<const char *>(data);
+
+    while (size != 0)
+    {
+        ssize_t written = ::write(fd, bytes, size);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw_errno("Failed to write " + path);
+        }
+
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+inline void sync_path(const std::string &path, int flags)
+{
+    int fd = ::open(path.c_str(), flags);
+    if (fd < 0)
+        throw_errno("Can't open " + path);
+
+    int status = ::fsync(fd);
+    ::close(fd);
+
+    if (status != 0)
+        throw_errno("Failed to fsync " + path);
+}
+
+}; // namespace detail
+
+/* Append-only log of accepted keys. The directory holds `checkpoint.snap`, a
+ * tree snapshot, and `wal.log`, the keys inserted or erased after that
+ * snapshot, in order:
+ *
+ *     Wal_Header | Frame_Header keys... [erase bitmap] | Frame_Header ...
+ *
+ * Every frame is one group commit with its own checksum, so a torn write at
+ * the tail is detected and dropped on recovery. Frames holding only inserts
+ * carry no bitmap.
+ *
+ * With a time limit, a flusher thread commits pending keys once
+ * policy.every_ms has passed since the last commit; mutex_ guards the
+ * pending keys and the file. A
+ * failed commit on that thread is rethrown by the next append or close. */
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+class Write_Ahead_Log
+{
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t max_frame_ops_ = 1 << 20;
+
+    std::string dir_;
+    std::string log_path_;
+    std::string checkpoint_path_;
+    Sync_Policy policy_;
+
+    int fd_ = -1;
+    std::vector<T> pending_;
+    std::vector<uint8_t> pending_erases_; // one byte per pending key
+    bool pending_has_erases_ = false;
+    clock::time_point last_commit_ = clock::now();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::thread flusher_;
+
+    void flush_on_time()
+    {
+        std::unique_lock lock(mutex_);
+
+        while (!stopping_)
+        {
+            /* An idle log sleeps until the first pending key wakes it. */
+            clock::time_point deadline = pending_.empty()
+                                             ? clock::now() + std::chrono::hours(1)
+                                             : last_commit_ + policy_.every_ms;
+            if (pending_.empty() || clock::now() < deadline)
+            {
+                wake_.wait_until(lock, deadline);
+                continue;
+            }
+
+            try
+            {
+                commit_locked();
+            }
+            catch (...)
+            {
+                error_ = std::current_exception();
+                return;
+            }
+        }
+    }
+
+    void stop_flusher()
+    {
+        if (!flusher_.joinable())
+            return;
+
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+
+        wake_.notify_one();
+        flusher_.join();
+    }
+
+    void rethrow_flusher_error()
+    {
+        if (error_)
+            std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+    void reset_log()
+    {
+        if (::ftruncate(fd_, 0) != 0 || ::lseek(fd_, 0, SEEK_SET) < 0)
+            detail::throw_errno("Failed to truncate " + log_path_);
+
+        detail::Wal_Header header{};
+        std::memcpy(header.magic, detail::wal_magic, sizeof(header.magic));
+        header.version = detail::wal_version;
+        header.key_size = sizeof(T);
+        header.key_type = static_cast<uint32_t>(RB::snapshot::key_type_of<T>());
+
+        detail::write_all(fd_, &header, sizeof(header), log_path_);
+
+        if (::fsync(fd_) != 0)
+            detail::throw_errno("Failed to fsync " + log_path_);
+    }
+
+    /* Returns the length of the valid prefix of the log. */
+    template <typename Tree>
+    size_t replay(Tree &tree) const
+    {
+        RB::snapshot::Mapped_File file(log_path_);
+
+        detail::Wal_Header header{};
+        if (file.size() < sizeof(header))
+            return 0;
+
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, detail::wal_magic, sizeof(header.magic)) !=
+                0 ||
+            header.version != detail::wal_version || header.key_size != sizeof(T))
+            throw std::runtime_error(log_path_ + ": incompatible log");
+
+        RB::snapshot::check_key_type<T>(header.key_type, log_path_);
+
+        size_t offset = sizeof(header);
+        size_t replayed = 0;
+
+        while (file.size() - offset >= sizeof(detail::Frame_Header))
+        {
+            detail::Frame_Header frame{};
+            std::memcpy(&frame, file.data() + offset, sizeof(frame));
+
+            if ((frame.flags & ~detail::frame_has_erases) != 0)
+                break;
+
+            size_t payload = size_t{frame.count} * sizeof(T);
+            if (frame.flags & detail::frame_has_erases)
+                payload += (size_t{frame.count} + 7) / 8;
+
+            if (file.size() - offset - sizeof(frame) < payload)
+                break;
+
+            const char *keys = file.data() + offset + sizeof(frame);
+            const char *erases = keys + size_t{frame.count} * sizeof(T);
+
+            RB::snapshot::Checksum checksum;
+            checksum.update(keys, payload);
+            if (checksum.value() != frame.checksum)
+                break;
+
+            for (size_t id = 0; id < frame.count; ++id)
+            {
+                T key{};
+                std::memcpy(&key, keys + id * sizeof(T), sizeof(T));
+
+                if ((frame.flags & detail::frame_has_erases) &&
+                    (static_cast<unsigned char>(erases[id / 8]) >> (id % 8) & 1))
+                    tree.erase(key);
+                else
+                    tree.insert(key);
+            }
+
+            replayed += frame.count;
+            offset += sizeof(frame) + payload;
+        }
+
+        LOG("replayed {} keys from {}\n", replayed, log_path_);
+
+        return offset;
+    }
+
+  public:
+    Write_Ahead_Log(const std::string &dir, const Sync_Policy &policy)
+        : dir_(dir)
+        , log_path_((std::filesystem::path(dir) / "wal.log").string())
+        , checkpoint_path_((std::filesystem::path(dir) / "checkpoint.snap").string())
+        , policy_(policy)
+    {
+        std::filesystem::create_directories(dir_);
+    }
+
+    Write_Ahead_Log(const Write_Ahead_Log &) = delete;
+    Write_Ahead_Log &operator=(const Write_Ahead_Log &) = delete;
+
+    ~Write_Ahead_Log()
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    /* Loads the latest checkpoint, replays the log tail on top of it and
+     * opens the log for appending. A torn tail is cut off. */
+    template <typename Tree>
+    void recover(Tree &tree)
+    {
+        if (std::filesystem::exists(checkpoint_path_))
+            tree.load(checkpoint_path_);
+
+        size_t valid = 0;
+        if (std::filesystem::exists(log_path_))
+            valid = replay(tree);
+
+        fd_ = ::open(log_path_.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd_ < 0)
+            detail::throw_errno("Can't open " + log_path_);
+
+        if (valid == 0)
+            reset_log();
+        else if (::ftruncate(fd_, static_cast<off_t>(valid)) != 0 ||
+                 ::lseek(fd_, 0, SEEK_END) < 0)
+            detail::throw_errno("Failed to truncate " + log_path_);
+
+        if (policy_.every_ms.count() != 0)
+            flusher_ = std::thread(&Write_Ahead_Log::flush_on_time, this);
+    }
+
+    void append(const T &key) { add(key, false); }
+
+    void append_erase(const T &key) { add(key, true); }
+
+    void add(const T &key, bool erased)
+    {
+        std::lock_guard lock(mutex_);
+        rethrow_flusher_error();
+
+        pending_.push_back(key);
+        pending_erases_.push_back(erased);
+        pending_has_erases_ = pending_has_erases_ || erased;
+
+        if ((policy_.every_ops != 0 && pending_.size() >= policy_.every_ops) ||
+            pending_.size() >= max_frame_ops_)
+            commit_locked();
+        else if (pending_.size() == 1)
+            wake_.notify_one();
+    }
+
+    /* Writes all pending keys as a single frame and fsyncs the log. */
+    void commit()
+    {
+        std::lock_guard lock(mutex_);
+        commit_locked();
+    }
+
+  private:
+    void commit_locked()
+    {
+        last_commit_ = clock::now();
+
+        if (pending_.empty())
+            return;
+
+        size_t payload = pending_.size() * sizeof(T);
+
+        detail::Frame_Header frame{};
+        frame.count = static_cast<uint32_t>(pending_.size());
+
+        std::vector<uint8_t> bitmap;
+        if (pending_has_erases_)
+        {
+            frame.flags = detail::frame_has_erases;
+            bitmap.resize((pending_.size() + 7) / 8);
+
+            for (size_t id = 0; id < pending_erases_.size(); ++id)
+                bitmap[id / 8] = static_cast<uint8_t>(bitmap[id / 8] |
+                                                      pending_erases_[id] << (id % 8));
+        }
+
+        RB::snapshot::Checksum checksum;
+        checksum.update(pending_.data(), payload);
+        checksum.update(bitmap.data(), bitmap.size());
+        frame.checksum = checksum.value();
+
+        /* A torn write between these is caught by the checksum. */
+        detail::write_all(fd_, &frame, sizeof(frame), log_path_);
+        detail::write_all(fd_, pending_.data(), payload, log_path_);
+        detail::write_all(fd_, bitmap.data(), bitmap.size(), log_path_);
+
+        if (::fsync(fd_) != 0)
+            detail::throw_errno("Failed to fsync " + log_path_);
+
+        pending_.clear();
+        pending_erases_.clear();
+        pending_has_erases_ = false;
+    }
+
+  public:
+
+    /* Persists the whole key set and starts an empty log. If the process dies
+     * between the rename and the truncation, recovery replays keys that are
+     * already in the checkpoint, which is harmless since inserts are
+     * idempotent. */
+    template <typename Tree>
+    void checkpoint(const Tree &tree)
+    {
+        std::lock_guard lock(mutex_);
+        commit_locked();
+
+        std::string tmp_path = checkpoint_path_ + ".tmp";
+
+        tree.save(tmp_path);
+        detail::sync_path(tmp_path, O_RDONLY);
+
+        if (std::rename(tmp_path.c_str(), checkpoint_path_.c_str()) != 0)
+            detail::throw_errno("Failed to rename " + tmp_path);
+
+        detail::sync_path(dir_, O_RDONLY);
+
+        reset_log();
+
+        LOG("checkpoint of {} keys written to {}\n", tree.size(),
+            checkpoint_path_);
+    }
+
+    void close()
+    {
+        if (fd_ < 0)
+            return;
+
+        stop_flusher();
+
+        try
+        {
+            rethrow_flusher_error();
+            commit();
+        }
+        catch (...)
+        {
+            ::close(fd_);
+            fd_ = -1;
+            throw;
+        }
+
+        ::close(fd_);
+        fd_ = -1;
+    }
+};
+
+/* Tree facade for range_queries::start that logs every key which actually
+ * enters or leaves the tree and checkpoints after policy.checkpoint_ops of
+ * them. Erases are logged too, so keys expired by a window stay gone after
+ * recovery; the window itself is not persisted. */
+template <typename Tree, typename T>
+class Logged_Tree
+{
+  private:
+    Tree tree_;
+    Write_Ahead_Log<T> wal_;
+    size_t checkpoint_ops_;
+    size_t since_checkpoint_ = 0;
+
+    void note_logged(size_t count)
+    {
+        since_checkpoint_ += count;
+
+        if (checkpoint_ops_ != 0 && since_checkpoint_ >= checkpoint_ops_)
+        {
+            wal_.checkpoint(tree_);
+            since_checkpoint_ = 0;
+        }
+    }
+
+  public:
+    using iterator = typename Tree::iterator;
+
+    Logged_Tree(const std::string &dir, const Sync_Policy &policy)
+        : wal_(dir, policy)
+        , checkpoint_ops_(policy.checkpoint_ops)
+    {
+        wal_.recover(tree_);
+    }
+
+    void insert(const T &key)
+    {
+        size_t old_size = tree_.size();
+
+        tree_.insert(key);
+
+        if (tree_.size() == old_size)
+            return;
+
+        wal_.append(key);
+        note_logged(1);
+    }
+
+    /* Logs the whole batch: keys that were already present replay as
+     * no-ops. */
+    template <typename ForwardIt>
+    void insert_sorted(ForwardIt first, ForwardIt last)
+        requires requires(Tree &tree) { tree.insert_sorted(first, last); }
+    {
+        size_t old_size = tree_.size();
+
+        tree_.insert_sorted(first, last);
+
+        if (tree_.size() == old_size)
+            return;
+
+        size_t count = 0;
+        for (; first != last; ++first, ++count)
+            wal_.append(*first);
+
+        note_logged(count);
+    }
+
+    size_t erase(const T &key)
+    {
+        size_t erased = tree_.erase(key);
+
+        if (erased == 0)
+            return 0;
+
+        wal_.append_erase(key);
+        note_logged(1);
+
+        return erased;
+    }
+
+    iterator lower_bound(const T &key) { return tree_.lower_bound(key); }
+
+    iterator upper_bound(const T &key) { return tree_.upper_bound(key); }
+
+    size_t range_count(const T &left_b, const T &right_b)
+    {
+        return tree_.range_count(left_b, right_b);
+    }
+
+    size_t rank(const T &key) { return tree_.rank(key); }
+
+    iterator select(size_t index) { return tree_.select(index); }
+
+    iterator begin() { return tree_.begin(); }
+
+    iterator end() { return tree_.end(); }
+
+    size_t size() const { return tree_.size(); }
+
+    void checkpoint()
+    {
+        wal_.checkpoint(tree_);
+        since_checkpoint_ = 0;
+    }
+
+    void close() { wal_.close(); }
+
+    void dump() const { tree_.dump(); }
+
+    const Tree &tree() const { return tree_; }
+};
+
+}; // namespace range_queries
+
+#endif // WAL_H
@@ -0,0 +1,241 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stddef.h> // for size_t
+
+#include <chrono>        // for steady_clock, duration, duration_cast
+#include <deque>         // for deque
+#include <stdexcept>     // for logic_error
+#include <unordered_map> // for unordered_map
+
+#include "log.h"
+
+namespace range_queries
+{
+
+/* Engines that can drop keys again and list the ones they hold, which is
+ * what expiry needs. */
+template <typename Tree, typename T>
+concept Erases_Keys = requires(Tree &tree, const T &key) {
+    tree.erase(key);
+    tree.size();
+    tree.begin() != tree.end();
+};
+
+/* Engine facade that makes keys expire: with a window of W inserts only the
+ * keys among the last W arrivals are counted, with a window of T seconds
+ * only those inserted during the last T seconds. Both windows may be active
+ * at once; a key re-inserted inside the window lives until its newest
+ * arrival expires.
+ *
+ * Arrivals are queued in insertion order, so each one is expired exactly
+ * once, with a single erase from the engine: O(log n) amortized per insert
+ * for the tree engines, and the queue never outgrows the window. Nothing is
+ * queued while no window is set; keys already present when one is set
+ * count as arriving at that moment, in key order. */
+template <typename Tree, typename T>
+class Windowed
+{
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct Arrival
+    {
+        T key;
+        clock::time_point time;
+    };
+
+    Tree &tree_;
+
+    size_t max_inserts_ = 0;
+    clock::duration max_age_ = clock::duration::zero();
+
+    std::deque<Arrival> arrivals_;
+    std::unordered_map<T, size_t> live_; // arrivals in the queue per key
+    size_t expired_ = 0;
+
+    bool timed() const { return max_age_ != clock::duration::zero(); }
+    bool active() const { return max_inserts_ != 0 || timed(); }
+
+    void expire_oldest()
+    {
+        auto found = live_.find(arrivals_.front().key);
+
+        if (--found->second == 0)
+        {
+            LOG("expiring {}\n", found->first);
+
+            tree_.erase(found->first);
+            live_.erase(found);
+            ++expired_;
+        }
+
+        arrivals_.pop_front();
+    }
+
+    void expire_by_count()
+    {
+        if (max_inserts_ == 0)
+            return;
+
+        while (arrivals_.size() > max_inserts_)
+            expire_oldest();
+    }
+
+    void expire_by_age()
+    {
+        if (!timed())
+            return;
+
+        clock::time_point oldest = clock::now() - max_age_;
+
+        while (!arrivals_.empty() && arrivals_.front().time <= oldest)
+            expire_oldest();
+    }
+
+    void forget_if_inactive()
+    {
+        if (active())
+            return;
+
+        arrivals_ = {};
+        live_ = {};
+    }
+
+    /* Queues the keys inserted while no window was set. */
+    void track_present_keys()
+    {
+        clock::time_point now = clock::now();
+
+        for (auto it = tree_.begin(); it != tree_.end(); ++it)
+        {
+            arrivals_.push_back({*it, now});
+            live_.emplace(*it, 1);
+        }
+    }
+
+  public:
+    explicit Windowed(Tree &tree)
+        : tree_(tree)
+    {}
+
+    /* Keeps only the keys of the last `count` inserts; 0 lifts the limit. */
+    void set_max_inserts(size_t count)
+    {
+        if (!active())
+            track_present_keys();
+
+        max_inserts_ = count;
+
+        forget_if_inactive();
+        expire_by_count();
+    }
+
+    /* Keeps only the keys inserted during the last `seconds`; 0 (or less)
+     * lifts the limit. */
+    void set_max_age(double seconds)
+    {
+        if (!active())
+            track_present_keys();
+
+        /* Arrivals queued by a count window alone carry no time yet. */
+        else if (!timed())
+        {
+            clock::time_point now = clock::now();
+            for (Arrival &arrival : arrivals_)
+                arrival.time = now;
+        }
+
+        max_age_ = seconds > 0 ? std::chrono::duration_cast<clock::duration>(
+                                     std::chrono::duration<double>(seconds))
+                               : clock::duration::zero();
+
+        forget_if_inactive();
+        expire_by_age();
+    }
+
+    /* Drops the keys that have aged out; queries call it first. */
+    void expire() { expire_by_age(); }
+
+    void insert(const T &key)
+    {
+        if (!active())
+        {
+            tree_.insert(key);
+            return;
+        }
+
+        tree_.insert(key);
+
+        ++live_[key];
+        arrivals_.push_back({key, timed() ? clock::now() : clock::time_point{}});
+
+        expire_by_count();
+        expire_by_age();
+    }
+
+    /* Whether inserts are queued to expire. Sorted bursts bypass the
+     * queue, so they are only taken while this is false. */
+    bool expiring() const { return active(); }
+
+    template <typename ForwardIt>
+    void insert_sorted(ForwardIt first, ForwardIt last)
+        requires requires(Tree &tree) { tree.insert_sorted(first, last); }
+    {
+        if (active())
+            throw std::logic_error("Sorted bursts can't be queued to expire");
+
+        tree_.insert_sorted(first, last);
+    }
+
+    auto lower_bound(const T &key) const
+        requires requires(Tree &tree) { tree.lower_bound(key); }
+    {
+        return tree_.lower_bound(key);
+    }
+
+    auto upper_bound(const T &key) const
+        requires requires(Tree &tree) { tree.upper_bound(key); }
+    {
+        return tree_.upper_bound(key);
+    }
+
+    size_t range_count(const T &left_b, const T &right_b)
+        requires requires(Tree &tree) { tree.range_count(left_b, right_b); }
+    {
+        return tree_.range_count(left_b, right_b);
+    }
+
+    auto rank(const T &key) const
+        requires requires(Tree &tree) { tree.rank(key); }
+    {
+        return tree_.rank(key);
+    }
+
+    auto select(size_t index) const
+        requires requires(Tree &tree) { tree.select(index); }
+    {
+        return tree_.select(index);
+    }
+
+    auto begin() const
+        requires requires(Tree &tree) { tree.begin(); }
+    {
+        return tree_.begin();
+    }
+
+    auto end() const
+        requires requires(Tree &tree) { tree.end(); }
+    {
+        return tree_.end();
+    }
+
+    size_t size() const { return tree_.size(); }
+
+    size_t window_size() const { return arrivals_.size(); }
+    size_t expired() const { return expired_; }
+};
+
+}; // namespace range_queries
+
+#endif // WINDOW_H
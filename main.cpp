@@ -1,14 +1,258 @@
-#include <iostream> // for cin, cout
+#include <stdint.h> // for int32_t, int64_t
 
-#include <set>
+#include <atomic>    // for atomic
+#include <chrono>    // for milliseconds
+#include <csignal>   // for signal, SIGINT, SIGTERM
+#include <exception> // for exception
+#include <fstream>   // for ifstream
+#include <iostream>  // for cin, cout, cerr
+#include <optional>  // for optional
+#include <set>       // for set
+#include <stdexcept> // for runtime_error
+#include <thread>    // for thread
+#include <type_traits> // for is_trivially_copyable_v
 
+#include "adaptive.h"      // for Adaptive
+#include "command_file.h"  // for is_command_file, Reader
+#include "net.h"           // for parse_address
+#include "options.h"       // for parse_options
+#include "profiler.h"      // for Profiler
 #include "range_queries.h" // for start
+#include "server.h"        // for Server
+#include "wal.h"           // for Logged_Tree, Sync_Policy
 
+#include "KLL_Sketch.h"
 #include "RB_Tree.h"
+#include "short_string.h"
+#include "Sorted_Array.h"
+#include "Splay_Tree.h"
+#include "Treap.h"
 
-int main()
+namespace
 {
-    range_queries::start<RB::Tree<int>, int>(std::cin, std::cout);
+
+std::atomic<bool> stop_requested{false};
+
+void request_stop(int) { stop_requested.store(true); }
+
+/* Runs the commands of --input, or of stdin, against `tree`. Binary command
+ * files are mapped and decoded in place. */
+template <typename Tree, typename T>
+void drive_input(const range_queries::Options &options, Tree &tree,
+                 range_queries::Profiler *profiler)
+{
+    namespace command_file = range_queries::command_file;
+
+    const std::string &path = options.input_path;
+
+    if (path.empty())
+        range_queries::start<Tree, T>(std::cin, std::cout, tree, options.pipeline,
+                                      options.cache_entries, profiler);
+    else if (command_file::is_command_file(path))
+    {
+        if constexpr (command_file::File_Key<T>)
+        {
+            RB::snapshot::Mapped_File file(path);
+            command_file::Reader<T> reader(file, path);
+
+            range_queries::start<Tree, T>(reader, std::cout, tree, options.pipeline,
+                                          options.cache_entries, profiler);
+        }
+        else
+            throw std::runtime_error(path + " is a binary command file, which "
+                                            "holds int32, int64 or double keys");
+    }
+    else
+    {
+        std::ifstream in(path);
+        if (!in.is_open())
+            throw std::runtime_error("Can't open " + path);
+
+        range_queries::start<Tree, T>(in, std::cout, tree, options.pipeline,
+                                      options.cache_entries, profiler);
+    }
+}
+
+/* drive_input(), with a latency profile on stderr under --profile and
+ * snapshots appended to the --profile-json file. */
+template <typename Tree, typename T>
+void drive(const range_queries::Options &options, Tree &tree)
+{
+    using range_queries::Profiler;
+
+    std::ofstream snapshots;
+    std::optional<Profiler> profiler;
+
+    if (!options.profile_json_path.empty())
+    {
+        snapshots.open(options.profile_json_path, std::ios::app);
+        if (!snapshots.is_open())
+            throw std::runtime_error("Can't open " + options.profile_json_path);
+
+        profiler.emplace(snapshots,
+                         std::chrono::milliseconds(options.profile_interval_ms));
+    }
+    else if (options.profile)
+        profiler.emplace();
+
+    drive_input<Tree, T>(options, tree, profiler ? &*profiler : nullptr);
+
+    if (!profiler)
+        return;
+
+    profiler->report(std::cerr);
+
+    if (snapshots.is_open())
+        profiler->write_json(snapshots) << std::endl;
+}
+
+template <typename Tree, typename T>
+void drive(const range_queries::Options &options)
+{
+    Tree tree;
+
+    drive<Tree, T>(options, tree);
+}
+
+template <typename T>
+void run_server(const range_queries::Options &options)
+{
+#ifdef __linux__
+    namespace server = range_queries::server;
+
+    server::Server_Options server_options;
+    server_options.address = range_queries::net::parse_address(options.listen_address);
+    server_options.threads = options.threads != 0
+                                 ? options.threads
+                                 : std::thread::hardware_concurrency();
+    server_options.session_trees = options.session_trees;
+
+    RB::Tree<T> tree;
+
+    if (!options.load_path.empty())
+        tree.load(options.load_path);
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    {
+        server::Server<RB::Tree<T>, T> instance(server_options, tree);
+        instance.run(stop_requested);
+    }
+
+    if (!options.save_path.empty())
+        tree.save(options.save_path);
+#else
+    (void)options;
+    throw std::runtime_error("--listen requires Linux (epoll)");
+#endif // __linux__
+}
+
+template <typename T>
+void run_logged(const range_queries::Options &options)
+{
+    range_queries::Sync_Policy policy;
+    policy.every_ops = options.wal_sync_ops;
+    policy.every_ms = std::chrono::milliseconds(options.wal_sync_ms);
+    policy.checkpoint_ops = options.wal_checkpoint_ops;
+
+    using Logged = range_queries::Logged_Tree<RB::Tree<T>, T>;
+
+    Logged tree(options.wal_dir, policy);
+
+    drive<Logged, T>(options, tree);
+
+    tree.close();
+
+    if (!options.save_path.empty())
+        tree.tree().save(options.save_path);
+}
+
+/* Snapshots, logs and the binary protocol copy keys as raw bytes, so they
+ * take no string keys; parse_options() rejects those combinations. */
+template <typename T>
+void run_tree(const range_queries::Options &options)
+{
+    RB::Tree<T> tree;
+
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        if (!options.load_path.empty())
+            tree.load(options.load_path);
+    }
+
+    drive<RB::Tree<T>, T>(options, tree);
+
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        if (!options.save_path.empty())
+            tree.save(options.save_path);
+    }
+}
+
+template <typename T>
+void run(const range_queries::Options &options)
+{
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        if (!options.listen_address.empty())
+        {
+            run_server<T>(options);
+            return;
+        }
+
+        if (!options.wal_dir.empty())
+        {
+            run_logged<T>(options);
+            return;
+        }
+    }
+
+    if (options.engine == "set")
+        drive<std::set<T>, T>(options);
+    else if (options.engine == "sorted")
+        drive<Sorted::Array<T>, T>(options);
+    else if (options.engine == "splay")
+        drive<Splay::Tree<T>, T>(options);
+    else if (options.engine == "treap")
+        drive<Treap::Tree<T>, T>(options);
+    else if (options.engine == "kll")
+    {
+        auto sketch = KLL::Sketch<T>::with_error(options.kll_error);
+        drive<KLL::Sketch<T>, T>(options, sketch);
+    }
+    else if (options.engine == "auto")
+    {
+        range_queries::Adaptive<T> engine(options.auto_window);
+        drive<range_queries::Adaptive<T>, T>(options, engine);
+    }
+    else
+        run_tree<T>(options);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        range_queries::Options options =
+            range_queries::parse_options(argc, argv);
+
+        if (options.key_type == "int64")
+            run<int64_t>(options);
+        else if (options.key_type == "double")
+            run<double>(options);
+        else if (options.key_type == "string")
+            run<RB::Short_String>(options);
+        else
+            run<int32_t>(options);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,162 @@
+#include <stdint.h> // for int32_t, int64_t
+
+#include <cstring>   // for memcpy
+#include <exception> // for exception
+#include <iostream>  // for cin, cout, cerr
+#include <limits>    // for numeric_limits
+#include <stdexcept> // for invalid_argument
+#include <string>    // for string
+
+#include "command_file.h"  // for Writer, Reader
+#include "range_queries.h" // for Command, read_command
+
+namespace
+{
+
+namespace command_file = range_queries::command_file;
+
+struct Convert_Options
+{
+    std::string key_type = "int32";
+    std::string to_text; // binary file to print as text
+};
+
+const char *usage()
+{
+    return "Usage: rq_convert.x [--key <int32|int64|double>] < commands.dat > commands.bin\n"
+           "       rq_convert.x --to-text commands.bin > commands.dat\n";
+}
+
+Convert_Options parse(int argc, char **argv)
+{
+    Convert_Options options;
+
+    for (int id = 1; id < argc; ++id)
+    {
+        std::string arg = argv[id];
+
+        auto value = [&]() -> std::string
+        {
+            if (id + 1 >= argc)
+                throw std::invalid_argument(arg + " expects a value\n" + usage());
+            return argv[++id];
+        };
+
+        if (arg == "--key")
+            options.key_type = value();
+        else if (arg == "--to-text")
+            options.to_text = value();
+        else
+            throw std::invalid_argument("Unknown option " + arg + '\n' + usage());
+    }
+
+    if (options.key_type != "int32" && options.key_type != "int64" &&
+        options.key_type != "double")
+        throw std::invalid_argument("Unknown key type " + options.key_type + '\n' +
+                                    usage());
+
+    return options;
+}
+
+template <typename T>
+void to_binary()
+{
+    command_file::Writer<T> writer(std::cout);
+    range_queries::Command<T> command;
+
+    while (range_queries::read_command(std::cin, command))
+        writer.write(command);
+
+    writer.finish();
+}
+
+template <typename T>
+void to_text(const std::string &path)
+{
+    RB::snapshot::Mapped_File file(path);
+    command_file::Reader<T> reader(file, path);
+    range_queries::Command<T> command;
+
+    std::cout.precision(std::numeric_limits<T>::max_digits10);
+
+    while (reader.next(command))
+    {
+        std::cout << command.option << ' ';
+
+        switch (command.option)
+        {
+            case 'k':
+            case 'n':
+                std::cout << command.first;
+                break;
+            case 'q':
+            case 'p':
+                std::cout << command.first << ' ' << command.second;
+                break;
+            case 'r':
+                std::cout << command.first << ' ' << command.second << ' '
+                          << command.third << ' ' << command.fourth;
+                break;
+            case 'w':
+            case 's':
+                std::cout << command.count;
+                break;
+            default:
+                std::cout << command.real;
+        }
+
+        std::cout << '\n';
+    }
+}
+
+/* The key type of a binary file comes from its header. */
+void to_text(const std::string &path)
+{
+    RB::snapshot::Mapped_File file(path);
+    command_file::Header header{};
+
+    if (file.size() >= sizeof(header))
+        std::memcpy(&header, file.data(), sizeof(header));
+
+    switch (static_cast<command_file::Key_Type>(header.key_type))
+    {
+        case command_file::Key_Type::int64:
+            to_text<int64_t>(path);
+            break;
+        case command_file::Key_Type::float64:
+            to_text<double>(path);
+            break;
+        case command_file::Key_Type::int32:
+        case command_file::Key_Type::other:
+        default:
+            to_text<int32_t>(path); // reports a bad header
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        Convert_Options options = parse(argc, argv);
+
+        std::ios::sync_with_stdio(false);
+
+        if (!options.to_text.empty())
+            to_text(options.to_text);
+        else if (options.key_type == "int64")
+            to_binary<int64_t>();
+        else if (options.key_type == "double")
+            to_binary<double>();
+        else
+            to_binary<int32_t>();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <stddef.h>     // for size_t
+#include <stdint.h>     // for uint64_t
+#include <sys/socket.h> // for recv
+#include <unistd.h>     // for close
+
+#include <chrono>    // for steady_clock, duration
+#include <exception> // for exception
+#include <iostream>  // for cout, cerr
+#include <random>    // for mt19937, uniform_int_distribution
+#include <stdexcept> // for invalid_argument, runtime_error
+#include <string>    // for string, stoull, stod
+#include <thread>    // for thread
+#include <vector>    // for vector
+
+#include "histogram.h" // for Latency_Histogram
+#include "net.h"       // for parse_address, connect_to, send_all
+
+namespace
+{
+
+struct Load_Options
+{
+    std::string address;
+    size_t clients = 4;
+    size_t ops = 100000;
+    size_t pipeline = 64;
+    size_t key_range = 1000000;
+    double query_ratio = 0.5;
+    bool binary = false;
+};
+
+const char *usage()
+{
+    return "Usage: rq_load_gen.x --connect <unix:path|tcp:port> [options]\n"
+           "\t--clients <n>     concurrent sessions (default 4)\n"
+           "\t--ops <n>         commands per session (default 100000)\n"
+           "\t--pipeline <n>    commands sent before reading answers (default 64)\n"
+           "\t--keys <n>        keys are drawn from [0, n) (default 1000000)\n"
+           "\t--queries <r>     fraction of q commands (default 0.5)\n"
+           "\t--binary          use the pipelined binary protocol\n";
+}
+
+Load_Options parse(int argc, char **argv)
+{
+    Load_Options options;
+
+    for (int id = 1; id < argc; ++id)
+    {
+        std::string arg = argv[id];
+
+        auto value = [&]() -> std::string
+        {
+            if (id + 1 >= argc)
+                throw std::invalid_argument(arg + " expects a value\n" + usage());
+            return argv[++id];
+        };
+
+        if (arg == "--connect")
+            options.address = value();
+        else if (arg == "--clients")
+            options.clients = std::stoull(value());
+        else if (arg == "--ops")
+            options.ops = std::stoull(value());
+        else if (arg == "--pipeline")
+            options.pipeline = std::stoull(value());
+        else if (arg == "--keys")
+            options.key_range = std::stoull(value());
+        else if (arg == "--queries")
+            options.query_ratio = std::stod(value());
+        else if (arg == "--binary")
+            options.binary = true;
+        else
+            throw std::invalid_argument("Unknown option " + arg + '\n' + usage());
+    }
+
+    if (options.address.empty() || options.pipeline == 0 || options.key_range == 0)
+        throw std::invalid_argument(usage());
+
+    return options;
+}
+
+/* Reads until `expected` answers have arrived: uint64_t counts in binary
+ * mode, space-terminated numbers in text mode. */
+void await_answers(int fd, size_t expected, bool binary)
+{
+    char buffer[4096];
+    size_t pending = binary ? expected * sizeof(uint64_t) : expected;
+
+    while (pending != 0)
+    {
+        ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            throw std::runtime_error("Connection closed by server");
+
+        if (binary)
+        {
+            pending -= static_cast<size_t>(received);
+            continue;
+        }
+
+        for (ssize_t id = 0; id < received; ++id)
+            if (buffer[id] == ' ')
+                --pending;
+    }
+}
+
+range_queries::Latency_Histogram run_client(const Load_Options &options,
+                                            size_t seed)
+{
+    using clock = std::chrono::steady_clock;
+
+    range_queries::Latency_Histogram latency;
+
+    int fd = range_queries::net::connect_to(
+        range_queries::net::parse_address(options.address));
+
+    std::mt19937 generator(static_cast<unsigned>(seed));
+    std::uniform_int_distribution<int> keys(0, static_cast<int>(options.key_range - 1));
+    std::bernoulli_distribution is_query(options.query_ratio);
+
+    std::string batch;
+
+    if (options.binary)
+        batch.push_back('\xB1');
+
+    auto append_key = [&](int key)
+    {
+        if (options.binary)
+            batch.append(reinterpret_cast<const char *>(&key), sizeof(key));
+        else
+            batch += std::to_string(key) + ' ';
+    };
+
+    for (size_t sent = 0; sent < options.ops;)
+    {
+        size_t queries = 0;
+
+        for (size_t id = 0; id < options.pipeline && sent < options.ops; ++id, ++sent)
+        {
+            int key = keys(generator);
+
+            if (is_query(generator))
+            {
+                batch += options.binary ? "q" : "q ";
+                append_key(key);
+                append_key(key + static_cast<int>(options.key_range / 100));
+                ++queries;
+            }
+            else
+            {
+                batch += options.binary ? "k" : "k ";
+                append_key(key);
+            }
+        }
+
+        clock::time_point start = clock::now();
+
+        if (!range_queries::net::send_all(fd, batch.data(), batch.size()))
+            throw std::runtime_error("Failed to send commands");
+
+        await_answers(fd, queries, options.binary);
+
+        latency.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start)
+                .count()));
+
+        batch.clear();
+    }
+
+    ::close(fd);
+
+    return latency;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        Load_Options options = parse(argc, argv);
+
+        std::vector<range_queries::Latency_Histogram> results(options.clients);
+        std::vector<std::thread> clients;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t id = 0; id < options.clients; ++id)
+            clients.emplace_back(
+                [&, id]
+                {
+                    try
+                    {
+                        results[id] = run_client(options, id + 1);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cerr << "client " << id << ": " << e.what() << std::endl;
+                    }
+                });
+
+        for (auto &client : clients)
+            client.join();
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        range_queries::Latency_Histogram total;
+        for (const auto &result : results)
+            total.merge(result);
+
+        double commands = static_cast<double>(options.clients * options.ops);
+
+        std::cout << "clients " << options.clients << ", commands " << options.ops
+                  << " each, pipeline " << options.pipeline
+                  << (options.binary ? ", binary" : ", text") << '\n'
+                  << "throughput " << commands / elapsed.count() << " commands/s\n"
+                  << "batch round trip us: p50 "
+                  << static_cast<double>(total.percentile(0.50)) / 1000.0 << " p99 "
+                  << static_cast<double>(total.percentile(0.99)) / 1000.0 << " p999 "
+                  << static_cast<double>(total.percentile(0.999)) / 1000.0 << " max "
+                  << static_cast<double>(total.max()) / 1000.0 << std::endl;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
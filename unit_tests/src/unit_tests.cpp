@@ -1,14 +1,45 @@
 #include <gtest/gtest.h>        // for Test, Message, TestInfo (ptr only)
 
 #include <stddef.h>             // for size_t
+#include <stdint.h>             // for int64_t
+#include <algorithm>            // for sort, lower_bound, upper_bound, equal, count_if
+#include <chrono>               // for milliseconds
+#include <cmath>                // for abs
+#include <filesystem>           // for temp_directory_path, remove
+#include <fstream>              // for fstream
 #include <iterator>             // for distance
+#include <limits>               // for numeric_limits
+#include <random>               // for mt19937, uniform_int_distribution
+#include <set>                  // for set
+#include <sstream>              // for stringstream
+#include <stdexcept>            // for runtime_error, invalid_argument
 #include <string>               // for basic_string
+#include <thread>               // for thread
 #include <utility>              // for move
+#include <vector>               // for vector
 
+#include "KLL_Sketch.h"         // for Sketch
+#include "Packed_Set.h"         // for Set
 #include "RB_Tree.h"            // for Tree
+#include "Range_Tree.h"         // for Static_Tree, Dynamic_Tree
+#include "Sorted_Array.h"       // for Array
+#include "Splay_Tree.h"         // for Tree
+#include "Treap.h"              // for Tree
+#include "adaptive.h"           // for Adaptive
+#include "command_file.h"       // for Writer, Reader
+#include "histogram.h"          // for Latency_Histogram
 #include "log.h"                // for MSG, LOG
+#include "net.h"                // for connect_to, send_all
+#include "pipeline.h"           // for Spsc_Ring
+#include "profiler.h"           // for Profiler
+#include "query_cache.h"        // for Query_Cache, Cached
+#include "radix_sort.h"         // for sort_unique
+#include "server.h"             // for Server
+#include "short_string.h"       // for Short_String
 #include "test_utils.h"         // for run_test
 #include "test_utils_detail.h"  // for Ref_Start_Wrapper, Start_Wrapper
+#include "wal.h"                // for Logged_Tree, Sync_Policy
+#include "window.h"             // for Windowed
 
 class RBTreeTest : public ::testing::Test
 {
@@ -223,6 +254,2269 @@ TEST(ref_range_queries, basic_5)
         "/common/basic_5");
 }
 
+// ------- engines -------
+
+TEST(sorted_array_range_queries, basic_1)
+{
+    test_utils::run_test<Sorted::Array<int>, int>("/common/basic_1");
+}
+
+TEST(sorted_array_range_queries, basic_2)
+{
+    test_utils::run_test<Sorted::Array<int>, int>("/common/basic_2");
+}
+
+TEST(sorted_array_range_queries, basic_3)
+{
+    test_utils::run_test<Sorted::Array<int>, int>("/common/basic_3");
+}
+
+TEST(sorted_array_range_queries, inverted_bounds)
+{
+    Sorted::Array<int> array;
+    for (int key : {1, 3, 5, 7, 9})
+        array.insert(key);
+
+    EXPECT_EQ(array.range_count(3, 7), 3u);
+    EXPECT_EQ(array.range_count(7, 3), 0u);
+    EXPECT_EQ(array.range_count(5, 4), 0u);
+    EXPECT_EQ(array.range_count(5, 5), 1u);
+}
+
+TEST(adaptive_range_queries, basic_4)
+{
+    test_utils::run_test<range_queries::Adaptive<int>, int>("/common/basic_4");
+}
+
+TEST(adaptive_range_queries, basic_5)
+{
+    test_utils::run_test<range_queries::Adaptive<int>, int>("/common/basic_5");
+}
+
+TEST(range_queries, int64_keys)
+{
+    test_utils::run_test<RB::Tree<long long>, long long>("/common/basic_1");
+}
+
+TEST(range_queries, double_keys)
+{
+    test_utils::run_test<RB::Tree<double>, double>("/common/basic_2");
+}
+
+TEST(key_types, short_string_order)
+{
+    std::mt19937 generator(45);
+    std::uniform_int_distribution<size_t> lengths(0, 40);
+    std::uniform_int_distribution<int> bytes(0, 3);
+    const char alphabet[] = {'\0', 'a', 'b', '\xff'};
+
+    std::vector<std::string> words;
+    for (int id = 0; id < 400; ++id)
+    {
+        std::string word(lengths(generator), 'a');
+        for (char &symbol : word)
+            symbol = alphabet[bytes(generator)];
+        words.push_back(word);
+    }
+
+    for (const std::string &lhs : words)
+    {
+        RB::Short_String left(lhs);
+        ASSERT_EQ(left.str(), lhs);
+        ASSERT_EQ(left.size(), lhs.size());
+
+        for (const std::string &rhs : words)
+        {
+            RB::Short_String right(rhs);
+            ASSERT_EQ(left < right, lhs < rhs) << lhs.size() << ' ' << rhs.size();
+            ASSERT_EQ(left == right, lhs == rhs);
+
+            if (lhs == rhs)
+            {
+                ASSERT_EQ(std::hash<RB::Short_String>{}(left),
+                          std::hash<RB::Short_String>{}(right));
+            }
+        }
+    }
+
+    RB::Short_String heap(std::string(100, 'x'));
+    RB::Short_String copy = heap;
+    RB::Short_String moved = std::move(heap);
+    EXPECT_EQ(copy, moved);
+    EXPECT_EQ(moved.str(), std::string(100, 'x'));
+
+    copy = RB::Short_String("short");
+    EXPECT_EQ(copy.str(), "short");
+}
+
+TEST(key_types, nan_keys)
+{
+    double nan = std::numeric_limits<double>::quiet_NaN();
+
+    RB::Tree<double> tree;
+    for (double key : {1.0, 2.0, 3.0})
+        tree.insert(key);
+
+    EXPECT_THROW(tree.insert(nan), std::invalid_argument);
+    EXPECT_EQ(tree.erase(nan), 0u);
+    EXPECT_EQ(tree.size(), 3u);
+    EXPECT_EQ(tree.range_count(nan, 5.0), 0u);
+    EXPECT_EQ(tree.range_count(0.0, nan), 0u);
+    EXPECT_EQ(tree.rank(nan), 0u);
+    EXPECT_EQ(tree.upper_rank(nan), 0u);
+    EXPECT_TRUE(tree.verify());
+
+    std::string commands = "k 1 k nan k 2 k -inf q 0 10 q nan 10 q 0 nan n nan "
+                           "q -inf +inf p nan 1 p 1 1 r 0 0 2 nan r 0 0 2 2";
+    std::string expected = "2 0 0 0 3 0 1 \n";
+
+    for (bool pipelined : {false, true})
+    {
+        std::stringstream rb_in(commands);
+        std::stringstream rb_out;
+        range_queries::start<RB::Tree<double>, double>(rb_in, rb_out, pipelined);
+        EXPECT_EQ(rb_out.str(), expected);
+
+        std::stringstream set_in(commands);
+        std::stringstream set_out;
+        range_queries::start<std::set<double>, double>(set_in, set_out, pipelined);
+        EXPECT_EQ(set_out.str(), expected);
+    }
+}
+
+TEST(key_types, double_keys_round_trip)
+{
+    std::string commands = "k 1234567.25 k 9007199254740993 k 0.1 s 2 f 1 n 0.2";
+    std::string expected = "1234567.25 9007199254740992 1 \n";
+
+    std::stringstream rb_in(commands);
+    std::stringstream rb_out;
+    range_queries::start<RB::Tree<double>, double>(rb_in, rb_out);
+    EXPECT_EQ(rb_out.str(), expected);
+
+    std::stringstream set_in(commands);
+    std::stringstream set_out;
+    range_queries::start<std::set<double>, double>(set_in, set_out, true);
+    EXPECT_EQ(set_out.str(), expected);
+}
+
+/* Random words, some longer than fit inline, under every engine; the
+ * answers must match std::set<std::string>. */
+TEST(key_types, string_keys)
+{
+    std::stringstream input;
+    std::mt19937 generator(46);
+    std::uniform_int_distribution<size_t> lengths(1, 40);
+    std::uniform_int_distribution<int> letters('a', 'e');
+
+    auto word = [&]
+    {
+        std::string text(lengths(generator), 'a');
+        for (char &symbol : text)
+            symbol = static_cast<char>(letters(generator));
+        return text;
+    };
+
+    for (int round = 0; round < 3000; ++round)
+    {
+        input << "k " << word() << ' ';
+
+        if (round == 2000)
+            input << "w 700 ";
+
+        if (round % 10 == 0)
+        {
+            std::string left = word();
+            std::string right = word();
+            input << "q " << left << ' ' << right << " n " << left << " s "
+                  << round / 20 + 1 << " f 0.5 ";
+        }
+    }
+
+    std::string commands = input.str();
+
+    std::stringstream plain_in(commands);
+    std::stringstream expected;
+    range_queries::start<std::set<std::string>, std::string>(plain_in, expected);
+
+    for (bool pipelined : {false, true})
+    {
+        std::stringstream rb_in(commands);
+        std::stringstream rb_out;
+        range_queries::start<RB::Tree<RB::Short_String>, RB::Short_String>(
+            rb_in, rb_out, pipelined, 64);
+        EXPECT_EQ(rb_out.str(), expected.str());
+    }
+
+    std::stringstream treap_in(commands);
+    std::stringstream treap_out;
+    range_queries::start<Treap::Tree<RB::Short_String>, RB::Short_String>(treap_in,
+                                                                          treap_out);
+    EXPECT_EQ(treap_out.str(), expected.str());
+}
+
+TEST(adaptive, expires_keys)
+{
+    std::string commands = "k 1 k 2 k 3 w 1 q 0 10 w 0 k 4 k 5 w 2 k 6 q 0 10 n 6 s 1";
+
+    std::stringstream set_in(commands);
+    std::stringstream expected;
+    range_queries::start<std::set<int>, int>(set_in, expected);
+    EXPECT_EQ(expected.str(), "1 2 1 5 \n");
+
+    for (size_t window : {size_t{1}, size_t{256}})
+    {
+        range_queries::Adaptive<int> engine(window);
+
+        std::stringstream adaptive_in(commands);
+        std::stringstream adaptive_out;
+        range_queries::start<range_queries::Adaptive<int>, int>(adaptive_in, adaptive_out,
+                                                                engine);
+        EXPECT_EQ(adaptive_out.str(), expected.str());
+    }
+}
+
+TEST(adaptive, follows_workload)
+{
+    range_queries::Adaptive<int> engine(256);
+    std::set<int> reference;
+
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> keys(0, 1000000);
+
+    for (int id = 0; id < 20000; ++id)
+    {
+        int key = keys(generator);
+        engine.insert(key);
+        reference.insert(key);
+    }
+
+    EXPECT_EQ(engine.engine(), range_queries::Adaptive<int>::Engine::tree);
+
+    for (int id = 0; id < 2000; ++id)
+    {
+        int left = keys(generator);
+        int right = left + 300000;
+
+        auto expected = std::distance(reference.lower_bound(left),
+                                      reference.upper_bound(right));
+        ASSERT_EQ(engine.range_count(left, right), static_cast<size_t>(expected));
+    }
+
+    EXPECT_EQ(engine.engine(), range_queries::Adaptive<int>::Engine::array);
+
+    for (int id = 0; id < 20000; ++id)
+    {
+        int key = keys(generator);
+        engine.insert(key);
+        reference.insert(key);
+    }
+
+    /* While the set is small even pure inserts are cheaper in the array, so
+     * the first batch moves there and back once before the queries. */
+    EXPECT_EQ(engine.engine(), range_queries::Adaptive<int>::Engine::tree);
+    EXPECT_EQ(engine.migrations(), 4);
+    EXPECT_EQ(engine.size(), reference.size());
+    EXPECT_EQ(engine.range_count(0, 1000000), reference.size());
+}
+
+// ------- order statistics -------
+
+TEST(order_statistics, match_std_set)
+{
+    RB::Tree<int> tree;
+    std::set<int> reference;
+
+    std::mt19937 generator(11);
+    std::uniform_int_distribution<int> keys(0, 3000);
+
+    auto check = [&]
+    {
+        ASSERT_TRUE(tree.verify());
+        ASSERT_EQ(tree.size(), reference.size());
+
+        size_t index = 0;
+        for (auto it = reference.begin(); it != reference.end(); ++it, ++index)
+        {
+            ASSERT_EQ(*tree.select(index), *it);
+            ASSERT_EQ(tree.rank(*it), index);
+            ASSERT_EQ(tree.upper_rank(*it), index + 1);
+        }
+        EXPECT_EQ(tree.select(index), tree.end());
+
+        for (int id = 0; id < 200; ++id)
+        {
+            int left = keys(generator);
+            int right = left + keys(generator) / 4;
+
+            ASSERT_EQ(tree.range_count(left, right),
+                      static_cast<size_t>(std::distance(reference.lower_bound(left),
+                                                        reference.upper_bound(right))));
+            ASSERT_EQ(tree.rank(left), static_cast<size_t>(std::distance(
+                                           reference.begin(), reference.lower_bound(left))));
+        }
+    };
+
+    for (int id = 0; id < 4000; ++id)
+    {
+        int key = keys(generator);
+        tree.insert(key);
+        reference.insert(key);
+    }
+    check();
+
+    for (int id = 0; id < 3000; ++id)
+    {
+        int key = keys(generator);
+        tree.erase(key);
+        reference.erase(key);
+    }
+    check();
+
+    RB::Tree<int> copy(tree);
+    EXPECT_TRUE(copy.verify());
+    EXPECT_EQ(*copy.select(copy.size() / 2), *tree.select(tree.size() / 2));
+
+    std::vector<int> sorted(reference.begin(), reference.end());
+    RB::Tree<int> bulk;
+    bulk.assign_sorted(sorted.begin(), sorted.end());
+    EXPECT_TRUE(bulk.verify());
+    EXPECT_EQ(bulk.range_count(0, 3000), sorted.size());
+}
+
+TEST(order_statistics, quantiles)
+{
+    RB::Tree<int> tree;
+    EXPECT_EQ(tree.quantile(0.5), tree.end());
+
+    for (int key = 1; key <= 100; ++key)
+        tree.insert(key);
+
+    EXPECT_EQ(*tree.quantile(0.0), 1);
+    EXPECT_EQ(*tree.quantile(0.5), 50);
+    EXPECT_EQ(*tree.quantile(0.99), 99);
+    EXPECT_EQ(*tree.quantile(0.999), 100);
+    EXPECT_EQ(*tree.quantile(1.0), 100);
+    EXPECT_THROW(tree.quantile(1.5), std::invalid_argument);
+}
+
+namespace
+{
+
+/* Same order as std::less, but not recognized as it: takes the generic
+ * three-way descents. */
+struct Plain_Less
+{
+    bool operator()(int lhs, int rhs) const { return lhs < rhs; }
+};
+
+template <typename Tree>
+void match_bounds(Tree &tree, const std::set<int> &reference, int max_key)
+{
+    ASSERT_TRUE(tree.verify());
+    ASSERT_EQ(tree.size(), reference.size());
+
+    for (int key = -1; key <= max_key + 1; ++key)
+    {
+        auto lower = reference.lower_bound(key);
+        auto upper = reference.upper_bound(key);
+
+        if (lower == reference.end())
+            ASSERT_EQ(tree.lower_bound(key), tree.end());
+        else
+            ASSERT_EQ(*tree.lower_bound(key), *lower);
+
+        if (upper == reference.end())
+            ASSERT_EQ(tree.upper_bound(key), tree.end());
+        else
+            ASSERT_EQ(*tree.upper_bound(key), *upper);
+
+        ASSERT_EQ(tree.rank(key),
+                  static_cast<size_t>(std::distance(reference.begin(), lower)));
+        ASSERT_EQ(tree.upper_rank(key),
+                  static_cast<size_t>(std::distance(reference.begin(), upper)));
+    }
+}
+
+} // namespace
+
+TEST(order_statistics, fast_and_generic_descents)
+{
+    RB::Tree<int> fast;
+    RB::Tree<int, Plain_Less> generic;
+    std::set<int> reference;
+
+    std::mt19937 generator(12);
+    std::uniform_int_distribution<int> keys(0, 500);
+
+    /* Plenty of duplicates, which the single-compare insert must catch. */
+    for (int id = 0; id < 2000; ++id)
+    {
+        int key = keys(generator);
+        fast.insert(key);
+        generic.insert(key);
+        reference.insert(key);
+    }
+    match_bounds(fast, reference, 500);
+    match_bounds(generic, reference, 500);
+
+    for (int id = 0; id < 1000; ++id)
+    {
+        int key = keys(generator);
+        fast.erase(key);
+        generic.erase(key);
+        reference.erase(key);
+    }
+    match_bounds(fast, reference, 500);
+    match_bounds(generic, reference, 500);
+}
+
+TEST(order_statistics, heterogeneous_lookups)
+{
+    RB::Tree<long long, std::less<>> tree;
+
+    for (long long key = 0; key < 100; ++key)
+        tree.insert(key * 1000000000LL);
+
+    /* Double probes reach the comparator as they are, not truncated to keys. */
+    EXPECT_EQ(*tree.lower_bound(7), 1000000000LL);
+    EXPECT_EQ(*tree.lower_bound(1e9), 1000000000LL);
+    EXPECT_EQ(*tree.upper_bound(1e9), 2000000000LL);
+    EXPECT_EQ(*tree.lower_bound(1.5e9), 2000000000LL);
+    EXPECT_EQ(tree.lower_bound(1e11), tree.end());
+
+    EXPECT_EQ(tree.rank(0.5), 1u);
+    EXPECT_EQ(tree.upper_rank(-0.5), 0u);
+    EXPECT_EQ(tree.range_count(0.5, 2.5e9), 2u);
+    EXPECT_EQ(tree.range_count(0.5, 0.6), 0u);
+    EXPECT_EQ(tree.range_count(-1, 99e9), 100u);
+}
+
+TEST(order_statistics, commands)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/order/basic_1");
+}
+
+TEST(order_statistics, commands_std_set)
+{
+    test_utils::run_test<std::set<int>, int>("/order/basic_1");
+}
+
+TEST(order_statistics, commands_sorted_array)
+{
+    test_utils::run_test<Sorted::Array<int>, int>("/order/basic_1");
+}
+
+TEST(order_statistics, commands_adaptive)
+{
+    test_utils::run_test<range_queries::Adaptive<int>, int>("/order/basic_1");
+}
+
+// ------- self-adjusting engines -------
+
+namespace
+{
+
+/* Random inserts, erases and skewed queries against std::set. */
+template <typename Tree>
+void match_std_set(unsigned seed)
+{
+    Tree tree;
+    std::set<int> reference;
+
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> keys(0, 3000);
+    std::uniform_int_distribution<int> hot(1000, 1020);
+
+    auto check = [&]
+    {
+        ASSERT_TRUE(tree.verify());
+        ASSERT_EQ(tree.size(), reference.size());
+        ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin(), reference.end()));
+
+        size_t index = 0;
+        for (auto it = reference.begin(); it != reference.end(); ++it, ++index)
+            ASSERT_EQ(*tree.select(index), *it);
+        EXPECT_EQ(tree.select(index), tree.end());
+
+        for (int id = 0; id < 400; ++id)
+        {
+            int left = id % 2 ? hot(generator) : keys(generator);
+            int right = left + keys(generator) / 8;
+
+            ASSERT_EQ(tree.range_count(left, right),
+                      static_cast<size_t>(std::distance(reference.lower_bound(left),
+                                                        reference.upper_bound(right))));
+            ASSERT_EQ(tree.rank(left), static_cast<size_t>(std::distance(
+                                           reference.begin(), reference.lower_bound(left))));
+
+            auto lower = tree.lower_bound(left);
+            auto expected = reference.lower_bound(left);
+            ASSERT_EQ(lower == tree.end(), expected == reference.end());
+            if (expected != reference.end())
+            {
+                ASSERT_EQ(*lower, *expected);
+            }
+        }
+        ASSERT_TRUE(tree.verify());
+    };
+
+    for (int id = 0; id < 4000; ++id)
+    {
+        int key = keys(generator);
+        tree.insert(key);
+        reference.insert(key);
+    }
+    check();
+
+    for (int id = 0; id < 3000; ++id)
+    {
+        int key = keys(generator);
+        ASSERT_EQ(tree.erase(key), reference.erase(key));
+    }
+    check();
+
+    Tree copy(tree);
+    EXPECT_TRUE(copy.verify());
+    EXPECT_TRUE(std::equal(copy.begin(), copy.end(), reference.begin(), reference.end()));
+}
+
+} // namespace
+
+TEST(splay_tree, matches_std_set)
+{
+    match_std_set<Splay::Tree<int>>(13);
+}
+
+TEST(treap, matches_std_set)
+{
+    match_std_set<Treap::Tree<int>>(17);
+}
+
+TEST(splay_range_queries, basic_1)
+{
+    test_utils::run_test<Splay::Tree<int>, int>("/common/basic_1");
+}
+
+TEST(splay_range_queries, basic_5)
+{
+    test_utils::run_test<Splay::Tree<int>, int>("/common/basic_5");
+}
+
+TEST(splay_range_queries, order)
+{
+    test_utils::run_test<Splay::Tree<int>, int>("/order/basic_1");
+}
+
+TEST(splay_range_queries, window)
+{
+    test_utils::run_test<Splay::Tree<int>, int>("/window/count_1");
+}
+
+TEST(treap_range_queries, basic_1)
+{
+    test_utils::run_test<Treap::Tree<int>, int>("/common/basic_1");
+}
+
+TEST(treap_range_queries, basic_5)
+{
+    test_utils::run_test<Treap::Tree<int>, int>("/common/basic_5");
+}
+
+TEST(treap_range_queries, order)
+{
+    test_utils::run_test<Treap::Tree<int>, int>("/order/basic_1");
+}
+
+TEST(treap_range_queries, window)
+{
+    test_utils::run_test<Treap::Tree<int>, int>("/window/count_1");
+}
+
+// ------- packed key sets -------
+
+namespace
+{
+
+template <typename T>
+void match_packed(const std::set<T> &reference, const std::vector<T> &probes)
+{
+    Packed::Set<T> packed(reference.begin(), reference.end());
+    std::vector<T> sorted(reference.begin(), reference.end());
+
+    ASSERT_EQ(packed.size(), sorted.size());
+    ASSERT_EQ(packed.keys(), sorted);
+
+    for (size_t index = 0; index < sorted.size(); ++index)
+        ASSERT_EQ(packed.select(index), sorted[index]);
+    EXPECT_EQ(packed.select(sorted.size()), std::nullopt);
+
+    auto rank = [&](const T &key)
+    {
+        return static_cast<size_t>(std::lower_bound(sorted.begin(), sorted.end(), key) -
+                                   sorted.begin());
+    };
+
+    for (size_t id = 0; id + 1 < probes.size(); ++id)
+    {
+        T left = std::min(probes[id], probes[id + 1]);
+        T right = std::max(probes[id], probes[id + 1]);
+
+        auto last = std::upper_bound(sorted.begin(), sorted.end(), right);
+        ASSERT_EQ(packed.range_count(left, right),
+                  static_cast<size_t>(last - sorted.begin()) - rank(left));
+        ASSERT_EQ(packed.rank(probes[id]), rank(probes[id]));
+        ASSERT_EQ(packed.contains(probes[id]), reference.count(probes[id]) != 0);
+    }
+}
+
+} // namespace
+
+TEST(packed_set, random_keys)
+{
+    std::mt19937 generator(31);
+    std::uniform_int_distribution<int> keys(-1000000, 1000000);
+
+    std::set<int> reference;
+    std::vector<int> probes;
+
+    for (int id = 0; id < 20000; ++id)
+    {
+        reference.insert(keys(generator));
+        probes.push_back(keys(generator));
+    }
+    probes.insert(probes.end(), reference.begin(), std::next(reference.begin(), 500));
+
+    match_packed(reference, probes);
+}
+
+TEST(packed_set, dense_ids)
+{
+    std::set<int> reference;
+    for (int key = 1000; key < 101000; ++key)
+        if (key % 1000 != 0)
+            reference.insert(key);
+
+    std::vector<int> probes;
+    for (int key = 900; key < 101100; key += 37)
+        probes.push_back(key);
+
+    match_packed(reference, probes);
+
+    Packed::Set<int> packed(reference.begin(), reference.end());
+    EXPECT_LT(packed.bits_per_key(), 3.0);
+}
+
+TEST(packed_set, extreme_keys)
+{
+    using limits = std::numeric_limits<int64_t>;
+
+    std::set<int64_t> reference = {limits::min(), limits::min() + 1, -5, 0, 7,
+                                   limits::max() - 1, limits::max()};
+    for (int64_t key = 0; key < 300; ++key)
+        reference.insert(key * key * key * key * key * key * key);
+
+    std::vector<int64_t> probes = {limits::min(), -6, -5, 0, 1, 7, 8, limits::max()};
+    probes.insert(probes.end(), reference.begin(), reference.end());
+
+    match_packed(reference, probes);
+}
+
+TEST(packed_set, build_from_tree)
+{
+    RB::Tree<int> tree;
+    for (int key = 0; key < 1000; ++key)
+        tree.insert(key * 3);
+
+    Packed::Set<int> packed(tree);
+    EXPECT_EQ(packed.size(), tree.size());
+    EXPECT_EQ(packed.range_count(0, 2999), tree.range_count(0, 2999));
+    EXPECT_EQ(packed.range_count(10, 20), 3u);
+
+    Packed::Set<int> empty;
+    EXPECT_EQ(empty.range_count(0, 10), 0u);
+    EXPECT_EQ(empty.select(0), std::nullopt);
+
+    std::vector<int> unsorted = {1, 3, 2};
+    EXPECT_THROW((Packed::Set<int>(unsorted.begin(), unsorted.end())),
+                 std::invalid_argument);
+}
+
+// ------- approximate counting -------
+
+TEST(kll_range_queries, basic_1)
+{
+    test_utils::run_test<KLL::Sketch<int>, int>("/common/basic_1");
+}
+
+class KLLTest : public ::testing::Test
+{
+  protected:
+    static constexpr double error = 0.01;
+    static constexpr int count = 200000;
+
+    std::vector<int> keys;
+
+    void SetUp() override
+    {
+        std::mt19937 generator(3);
+        std::uniform_int_distribution<int> distribution(0, 1 << 30);
+
+        for (int id = 0; id < count; ++id)
+            keys.push_back(distribution(generator));
+    }
+
+    /* Largest range count deviation as a fraction of the stream length. */
+    double max_error(KLL::Sketch<int> &sketch) const
+    {
+        std::vector<int> sorted = keys;
+        std::sort(sorted.begin(), sorted.end());
+
+        double worst = 0;
+
+        for (int left = 0; left < (1 << 30); left += (1 << 24))
+        {
+            int right = left + (1 << 27);
+
+            double exact = static_cast<double>(
+                std::upper_bound(sorted.begin(), sorted.end(), right) -
+                std::lower_bound(sorted.begin(), sorted.end(), left));
+            double estimate = static_cast<double>(sketch.range_count(left, right));
+
+            worst = std::max(worst, std::abs(estimate - exact) / count);
+        }
+
+        return worst;
+    }
+};
+
+TEST_F(KLLTest, bounded_error_and_memory)
+{
+    auto sketch = KLL::Sketch<int>::with_error(error);
+
+    for (int key : keys)
+        sketch.insert(key);
+
+    EXPECT_EQ(sketch.count(), count);
+    EXPECT_LT(sketch.retained(), 4 * sketch.k());
+    EXPECT_LT(max_error(sketch), 2 * error);
+}
+
+TEST_F(KLLTest, merged_shards)
+{
+    std::vector<KLL::Sketch<int>> shards(4, KLL::Sketch<int>::with_error(error));
+
+    for (size_t id = 0; id < keys.size(); ++id)
+        shards[id % shards.size()].insert(keys[id]);
+
+    KLL::Sketch<int> merged = shards[0];
+    for (size_t id = 1; id < shards.size(); ++id)
+        merged.merge(shards[id]);
+
+    EXPECT_EQ(merged.count(), count);
+    EXPECT_LT(merged.retained(), 4 * merged.k());
+    EXPECT_LT(max_error(merged), 2 * error);
+}
+
+// ------- snapshot -------
+
+class SnapshotTest : public RBTreeTest
+{
+  protected:
+    std::string path =
+        (std::filesystem::temp_directory_path() / "rb_snapshot_test.bin")
+            .string();
+
+    void TearDown() override { std::filesystem::remove(path); }
+};
+
+TEST_F(SnapshotTest, round_trip)
+{
+    tree.save(path);
+
+    RB::Tree<int> loaded;
+    loaded.load(path);
+
+    EXPECT_TRUE(loaded.verify());
+    EXPECT_EQ(loaded.size(), size);
+    EXPECT_EQ(std::distance(loaded.lower_bound(min), loaded.upper_bound(max)),
+              size);
+    EXPECT_EQ(*loaded.lower_bound(11), 12);
+}
+
+TEST_F(SnapshotTest, insert_after_load)
+{
+    tree.save(path);
+
+    RB::Tree<int> loaded;
+    loaded.load(path);
+
+    for (int key = 0; key < 100; ++key)
+        loaded.insert(key);
+
+    EXPECT_TRUE(loaded.verify());
+    EXPECT_EQ(loaded.size(), 100);
+    EXPECT_EQ(std::distance(loaded.lower_bound(0), loaded.upper_bound(99)),
+              100);
+}
+
+TEST_F(SnapshotTest, empty_tree)
+{
+    RB::Tree<int> empty;
+    empty.save(path);
+
+    tree.load(path);
+
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.lower_bound(min), nullptr);
+}
+
+TEST_F(SnapshotTest, corrupted_checksum)
+{
+    tree.save(path);
+
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in |
+                                    std::ios::out);
+        file.seekp(-1, std::ios::end);
+        file.put('\x7f');
+    }
+
+    RB::Tree<int> loaded;
+    EXPECT_THROW(loaded.load(path), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, key_size_mismatch)
+{
+    tree.save(path);
+
+    RB::Tree<long long> loaded;
+    EXPECT_THROW(loaded.load(path), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, key_type_mismatch)
+{
+    RB::Tree<int64_t> saved;
+    for (int64_t key = 1; key <= 3; ++key)
+        saved.insert(key);
+    saved.save(path);
+
+    RB::Tree<double> loaded;
+    try
+    {
+        loaded.load(path);
+        FAIL() << "int64 keys loaded as double";
+    }
+    catch (const std::runtime_error &error)
+    {
+        EXPECT_NE(std::string(error.what()).find("run with --key int64"),
+                  std::string::npos)
+            << error.what();
+    }
+
+    EXPECT_EQ(loaded.size(), 0);
+}
+
+TEST(assign_sorted, matches_inserts)
+{
+    for (int count = 0; count < 70; ++count)
+    {
+        std::vector<int> keys;
+        for (int key = 0; key < count; ++key)
+            keys.push_back(key * 2);
+
+        RB::Tree<int> tree;
+        tree.assign_sorted(keys.begin(), keys.end());
+
+        EXPECT_TRUE(tree.verify());
+        EXPECT_EQ(tree.size(), keys.size());
+        EXPECT_EQ(std::distance(tree.lower_bound(1), tree.upper_bound(2 * count)),
+                  count > 0 ? count - 1 : 0);
+    }
+}
+
+// ------- expiry -------
+
+TEST(erase, matches_std_set)
+{
+    RB::Tree<int> tree;
+    std::set<int> reference;
+
+    std::mt19937 generator(31);
+    std::uniform_int_distribution<int> keys(0, 500);
+
+    for (int id = 0; id < 20000; ++id)
+    {
+        int key = keys(generator);
+
+        if (id % 3 == 0)
+        {
+            EXPECT_EQ(tree.erase(key), reference.erase(key));
+        }
+        else
+        {
+            tree.insert(key);
+            reference.insert(key);
+        }
+
+        if (id % 1000 == 0)
+        {
+            EXPECT_TRUE(tree.verify());
+        }
+    }
+
+    EXPECT_TRUE(tree.verify());
+    EXPECT_EQ(tree.size(), reference.size());
+    EXPECT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin(), reference.end()));
+
+    for (int key = 0; key <= 500; ++key)
+        tree.erase(key);
+
+    EXPECT_TRUE(tree.verify());
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.begin(), tree.end());
+}
+
+TEST(window, count_1)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/window/count_1");
+}
+
+TEST(window, count_1_sorted_array)
+{
+    test_utils::run_test<Sorted::Array<int>, int>("/window/count_1");
+}
+
+TEST(window, count_1_std_set)
+{
+    test_utils::run_test<std::set<int>, int>("/window/count_1");
+}
+
+TEST(window, bounded_by_count)
+{
+    RB::Tree<int> tree;
+    range_queries::Windowed<RB::Tree<int>, int> windowed(tree);
+
+    windowed.set_max_inserts(100);
+
+    for (int key = 0; key < 10000; ++key)
+    {
+        windowed.insert(key % 700);
+
+        EXPECT_LE(tree.size(), 100);
+        EXPECT_LE(windowed.window_size(), 100);
+    }
+
+    EXPECT_TRUE(tree.verify());
+    EXPECT_EQ(std::distance(tree.lower_bound(0), tree.upper_bound(700)), 100);
+}
+
+TEST(window, expires_by_age)
+{
+    RB::Tree<int> tree;
+    range_queries::Windowed<RB::Tree<int>, int> windowed(tree);
+
+    windowed.insert(1); // before the window: arrives when it is set
+    windowed.set_max_age(0.05);
+    windowed.insert(2);
+    windowed.insert(3);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+
+    windowed.insert(4);
+    windowed.expire();
+
+    EXPECT_EQ(tree.size(), 1);
+    EXPECT_EQ(*tree.begin(), 4);
+    EXPECT_EQ(windowed.expired(), 3);
+
+    windowed.set_max_age(0);
+    windowed.insert(5);
+
+    EXPECT_EQ(windowed.window_size(), 0);
+    EXPECT_EQ(tree.size(), 2);
+}
+
+TEST(window, keys_before_the_window_expire)
+{
+    std::string commands = "k 1 k 2 w 1 k 3 q 0 10 w 0 k 4 k 5 t 60 w 2 q 0 10";
+
+    for (bool pipelined : {false, true})
+    {
+        std::stringstream rb_in(commands);
+        std::stringstream rb_out;
+        range_queries::start<RB::Tree<int>, int>(rb_in, rb_out, pipelined);
+        EXPECT_EQ(rb_out.str(), "1 2 \n");
+
+        std::stringstream set_in(commands);
+        std::stringstream set_out;
+        range_queries::start<std::set<int>, int>(set_in, set_out, pipelined);
+        EXPECT_EQ(set_out.str(), "1 2 \n");
+    }
+}
+
+// ------- copying -------
+
+TEST(copy, parallel_matches_sequential)
+{
+    RB::Tree<int> tree;
+
+    std::mt19937 generator(17);
+    std::uniform_int_distribution<int> keys(0, 1 << 24);
+
+    for (int id = 0; id < 300000; ++id)
+        tree.insert(keys(generator));
+
+    for (int id = 0; id < 1000; ++id)
+        tree.erase(keys(generator));
+
+    RB::Tree<int> sequential = tree.copy(1);
+    RB::Tree<int> parallel = tree.copy(8);
+    RB::Tree<int> constructed(tree);
+
+    for (const RB::Tree<int> *copy : {&sequential, &parallel, &constructed})
+    {
+        EXPECT_TRUE(copy->verify());
+        EXPECT_EQ(copy->size(), tree.size());
+    }
+
+    EXPECT_TRUE(std::equal(parallel.begin(), parallel.end(), tree.begin(), tree.end()));
+    EXPECT_TRUE(std::equal(sequential.begin(), sequential.end(), tree.begin(), tree.end()));
+
+    parallel.insert(-1);
+    EXPECT_EQ(tree.rank(0), 0);
+    EXPECT_TRUE(parallel.verify());
+}
+
+TEST(copy, clone_is_copy_on_write)
+{
+    RB::Tree<int> tree;
+    for (int key = 0; key < 1000; ++key)
+        tree.insert(key * 2);
+
+    RB::Tree<int> clone = tree.clone();
+    RB::Tree<int> second = clone.clone();
+
+    EXPECT_TRUE(tree.is_shared());
+    EXPECT_EQ(*clone.select(10), 20);
+
+    clone.insert(1);
+    clone.erase(0);
+
+    EXPECT_FALSE(clone.is_shared());
+    EXPECT_TRUE(clone.verify());
+    EXPECT_EQ(clone.size(), 1000);
+    EXPECT_EQ(*clone.begin(), 1);
+
+    EXPECT_EQ(tree.size(), 1000);
+    EXPECT_EQ(*tree.begin(), 0);
+    EXPECT_EQ(*second.begin(), 0);
+
+    tree.erase(2);
+    EXPECT_TRUE(tree.verify());
+    EXPECT_EQ(second.rank(3), 2);
+
+    /* The last owner takes the nodes back instead of copying them. */
+    EXPECT_TRUE(second.is_shared());
+    second.insert(5000);
+    EXPECT_FALSE(second.is_shared());
+    EXPECT_TRUE(second.verify());
+    EXPECT_EQ(second.size(), 1001);
+}
+
+TEST(copying, compact)
+{
+    RB::Tree<int> tree;
+    std::mt19937 generator(21);
+    std::uniform_int_distribution<int> keys(0, 1 << 20);
+
+    for (int id = 0; id < 20000; ++id)
+        tree.insert(keys(generator));
+    for (int id = 0; id < 60000; ++id)
+        tree.erase(keys(generator));
+
+    std::vector<int> before(tree.begin(), tree.end());
+    RB::Tree<int> snapshot = tree.clone();
+    size_t bytes = tree.bytes();
+
+    tree.compact(2);
+
+    EXPECT_TRUE(tree.verify());
+    EXPECT_FALSE(tree.is_shared());
+    EXPECT_LT(tree.bytes(), bytes);
+    EXPECT_TRUE(std::equal(tree.begin(), tree.end(), before.begin(), before.end()));
+    EXPECT_TRUE(std::equal(snapshot.begin(), snapshot.end(), before.begin(), before.end()));
+
+    /* Neighbours in key order are neighbours in memory. */
+    auto address = [](const int &key) { return reinterpret_cast<const char*>(&key); };
+    auto step = address(*std::next(tree.begin())) - address(*tree.begin());
+    for (auto it = tree.begin(), next = std::next(it); next != tree.end(); ++it, ++next)
+        ASSERT_EQ(address(*next) - address(*it), step);
+
+    RB::Tree<int> empty;
+    empty.compact();
+    EXPECT_EQ(empty.size(), 0);
+    EXPECT_EQ(empty.bytes(), 0);
+}
+
+TEST(copying, auto_compact)
+{
+    RB::Tree<int> manual;
+    RB::Tree<int> automatic;
+    automatic.set_auto_compact(0.5);
+    EXPECT_THROW(automatic.set_auto_compact(-1), std::invalid_argument);
+
+    for (int key = 0; key < 50000; ++key)
+    {
+        manual.insert(key);
+        automatic.insert(key);
+    }
+    for (int key = 0; key < 50000; key += 10)
+    {
+        manual.erase(key + 1);
+        automatic.erase(key + 1);
+    }
+    for (int key = 0; key < 45000; ++key)
+    {
+        manual.erase(key);
+        automatic.erase(key);
+    }
+
+    EXPECT_TRUE(automatic.verify());
+    EXPECT_EQ(automatic.size(), manual.size());
+    EXPECT_TRUE(std::equal(automatic.begin(), automatic.end(), manual.begin(),
+                           manual.end()));
+    EXPECT_LT(automatic.bytes() * 4, manual.bytes());
+}
+
+// ------- diagnostics -------
+
+namespace
+{
+
+size_t occurrences(const std::string &text, const std::string &pattern)
+{
+    size_t count = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos;
+         at = text.find(pattern, at + 1))
+        ++count;
+    return count;
+}
+
+} // namespace
+
+TEST(diagnostics, dump_limits)
+{
+    std::vector<int> keys(100000);
+    for (size_t id = 0; id < keys.size(); ++id)
+        keys[id] = static_cast<int>(id);
+
+    RB::Tree<int> tree;
+    tree.assign_sorted(keys.begin(), keys.end());
+
+    std::stringstream full;
+    tree.dump(full, {});
+    EXPECT_EQ(occurrences(full.str(), "val: "), keys.size());
+    EXPECT_EQ(occurrences(full.str(), " keys\""), 0u);
+
+    RB::Dump_Options<int> shallow;
+    shallow.max_depth = 2;
+
+    std::stringstream top;
+    tree.dump(top, shallow);
+    EXPECT_EQ(occurrences(top.str(), "val: "), 7u);
+    EXPECT_EQ(occurrences(top.str(), " keys\""), 8u);
+
+    RB::Dump_Options<int> focused;
+    focused.focus_from = 500;
+    focused.focus_to = 510;
+
+    std::stringstream focus;
+    tree.dump(focus, focused);
+    for (int key = 500; key <= 510; ++key)
+        EXPECT_NE(focus.str().find("val: " + std::to_string(key) + " "),
+                  std::string::npos);
+    EXPECT_LT(occurrences(focus.str(), "val: "), 60u);
+
+    RB::Dump_Options<int> sampled;
+    sampled.sample_every = 3;
+
+    std::stringstream sample;
+    tree.dump(sample, sampled);
+    EXPECT_LT(occurrences(sample.str(), "val: "), 1000u);
+    EXPECT_GT(occurrences(sample.str(), " keys\""), 0u);
+}
+
+TEST(diagnostics, shape)
+{
+    std::vector<int> keys(1023);
+    for (size_t id = 0; id < keys.size(); ++id)
+        keys[id] = static_cast<int>(id);
+
+    RB::Tree<int> perfect;
+    perfect.assign_sorted(keys.begin(), keys.end());
+
+    RB::Shape_Stats stats = perfect.shape();
+    EXPECT_EQ(stats.nodes, 1023u);
+    EXPECT_EQ(stats.height, 10u);
+    EXPECT_EQ(stats.min_leaf_depth, 9u);
+    EXPECT_DOUBLE_EQ(stats.height_ratio(), 1.0);
+    ASSERT_EQ(stats.level_counts.size(), 10u);
+    for (size_t level = 0; level < 10; ++level)
+        EXPECT_EQ(stats.level_counts[level], size_t{1} << level);
+
+    RB::Tree<int> random;
+    std::mt19937 generator(51);
+    for (int id = 0; id < 50000; ++id)
+        random.insert(static_cast<int>(generator() % 1000000));
+
+    stats = random.shape();
+    EXPECT_EQ(stats.nodes, random.size());
+    EXPECT_GT(stats.black_height, 0u);
+    EXPECT_LT(stats.height_ratio(), 2.0);
+    EXPECT_LE(stats.min_leaf_depth + 1, stats.height);
+
+    size_t total = 0;
+    for (size_t count : stats.level_counts)
+        total += count;
+    EXPECT_EQ(total, stats.nodes);
+
+    std::stringstream json;
+    RB::write_json(json, stats);
+    EXPECT_NE(json.str().find("\"nodes\": " + std::to_string(stats.nodes)),
+              std::string::npos);
+
+    EXPECT_EQ(RB::Tree<int>().shape().nodes, 0u);
+}
+
+// ------- 2D range counting -------
+
+namespace
+{
+
+using Point = Range::Point<int>;
+
+struct Rectangle
+{
+    int x1, y1, x2, y2;
+};
+
+size_t brute_count(const std::vector<Point> &points, const Rectangle &rect)
+{
+    return static_cast<size_t>(std::count_if(
+        points.begin(), points.end(),
+        [&](const Point &p)
+        { return rect.x1 <= p.x && p.x <= rect.x2 && rect.y1 <= p.y && p.y <= rect.y2; }));
+}
+
+std::vector<Rectangle> random_rectangles(std::mt19937 &generator, int range, size_t count)
+{
+    std::uniform_int_distribution<int> coords(-2, range + 2);
+    std::vector<Rectangle> result;
+
+    for (size_t id = 0; id < count; ++id)
+        result.push_back({coords(generator), coords(generator), coords(generator),
+                          coords(generator)});
+
+    return result;
+}
+
+} // namespace
+
+TEST(range_tree, static_matches_brute_force)
+{
+    std::mt19937 generator(5);
+
+    for (size_t count : {0u, 1u, 2u, 3u, 7u, 64u, 100u, 1000u})
+    {
+        std::uniform_int_distribution<int> coords(0, 40);
+
+        std::vector<Point> points;
+        for (size_t id = 0; id < count; ++id)
+            points.push_back({coords(generator), coords(generator)});
+
+        Range::Static_Tree<int> tree(points);
+        EXPECT_EQ(tree.size(), count);
+
+        for (const Rectangle &rect : random_rectangles(generator, 40, 300))
+            EXPECT_EQ(tree.count(rect.x1, rect.y1, rect.x2, rect.y2),
+                      brute_count(points, rect));
+    }
+}
+
+TEST(range_tree, dynamic_matches_brute_force)
+{
+    std::mt19937 generator(6);
+    std::uniform_int_distribution<int> coords(0, 200);
+
+    Range::Dynamic_Tree<int> tree;
+    std::vector<Point> points;
+
+    for (int id = 0; id < 5000; ++id)
+    {
+        Point point{coords(generator), coords(generator)};
+        tree.insert(point.x, point.y);
+        points.push_back(point);
+
+        if (id % 97 == 0)
+        {
+            for (const Rectangle &rect : random_rectangles(generator, 200, 5))
+                EXPECT_EQ(tree.count(rect.x1, rect.y1, rect.x2, rect.y2),
+                          brute_count(points, rect));
+        }
+    }
+
+    EXPECT_EQ(tree.size(), points.size());
+    EXPECT_LE(tree.trees(), 8);
+}
+
+TEST(range_tree, batch_is_folded)
+{
+    Range::Dynamic_Tree<int> tree;
+
+    for (int id = 0; id < 10000; ++id)
+        tree.insert(id, id % 100);
+
+    EXPECT_GT(tree.trees(), 1);
+    EXPECT_EQ(tree.count(0, 0, 9999, 9), 1000);
+    EXPECT_EQ(tree.trees(), 1);
+}
+
+TEST(range_queries, points_and_rectangles)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/plane/basic_1");
+}
+
+// ------- write-ahead log -------
+
+class WalTest : public ::testing::Test
+{
+  protected:
+    using Logged = range_queries::Logged_Tree<RB::Tree<int>, int>;
+
+    std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / "rb_wal_test";
+    range_queries::Sync_Policy policy;
+
+    void SetUp() override
+    {
+        std::filesystem::remove_all(dir);
+
+        policy.every_ops = 4;
+        policy.checkpoint_ops = 0;
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir); }
+
+    static long count(const RB::Tree<int> &tree)
+    {
+        return std::distance(tree.lower_bound(0), tree.upper_bound(1000));
+    }
+};
+
+TEST_F(WalTest, replays_log)
+{
+    {
+        Logged tree(dir.string(), policy);
+        for (int key = 0; key < 10; ++key)
+            tree.insert(key);
+    }
+
+    Logged recovered(dir.string(), policy);
+
+    EXPECT_EQ(count(recovered.tree()), 10);
+    EXPECT_FALSE(std::filesystem::exists(dir / "checkpoint.snap"));
+}
+
+TEST_F(WalTest, checkpoint_truncates_log)
+{
+    policy.checkpoint_ops = 10;
+
+    {
+        Logged tree(dir.string(), policy);
+        for (int key = 0; key < 25; ++key)
+            tree.insert(key);
+        for (int key = 0; key < 25; ++key)
+            tree.insert(key);
+    }
+
+    EXPECT_TRUE(std::filesystem::exists(dir / "checkpoint.snap"));
+    EXPECT_LT(std::filesystem::file_size(dir / "wal.log"), 25 * sizeof(int));
+
+    Logged recovered(dir.string(), policy);
+
+    EXPECT_TRUE(recovered.tree().verify());
+    EXPECT_EQ(count(recovered.tree()), 25);
+}
+
+TEST_F(WalTest, torn_tail_is_dropped)
+{
+    {
+        Logged tree(dir.string(), policy);
+        for (int key = 0; key < 8; ++key)
+            tree.insert(key);
+    }
+
+    {
+        std::ofstream log(dir / "wal.log", std::ios::binary | std::ios::app);
+        log.write("\x03\x00\x00\x00garbage", 11);
+    }
+
+    {
+        Logged recovered(dir.string(), policy);
+        EXPECT_EQ(count(recovered.tree()), 8);
+
+        recovered.insert(100);
+    }
+
+    Logged recovered(dir.string(), policy);
+    EXPECT_EQ(count(recovered.tree()), 9);
+}
+
+TEST_F(WalTest, rejects_another_key_type)
+{
+    {
+        range_queries::Logged_Tree<RB::Tree<int64_t>, int64_t> tree(dir.string(), policy);
+        tree.insert(1);
+    }
+
+    using Doubles = range_queries::Logged_Tree<RB::Tree<double>, double>;
+    EXPECT_THROW(Doubles(dir.string(), policy), std::runtime_error);
+}
+
+TEST_F(WalTest, commits_on_time_while_idle)
+{
+    policy.every_ops = 0;
+    policy.every_ms = std::chrono::milliseconds(5);
+
+    Logged tree(dir.string(), policy);
+    for (int key = 0; key < 3; ++key)
+        tree.insert(key);
+
+    size_t committed = sizeof(range_queries::detail::Wal_Header) +
+                       sizeof(range_queries::detail::Frame_Header) + 3 * sizeof(int);
+
+    for (int wait = 0; wait < 200 && std::filesystem::file_size(dir / "wal.log") <
+                                         committed; ++wait)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    EXPECT_EQ(std::filesystem::file_size(dir / "wal.log"), committed);
+}
+
+TEST_F(WalTest, answers_like_the_plain_engine)
+{
+    std::string commands = "w 3 k 5 k 1 k 9 q 2 8 s 2 n 6 f 0.5 k 3 k 7 k 11 "
+                           "q 0 20 s 1 n 9 f 1 k 13 q 0 20 s 3 ";
+
+    std::stringstream plain_in(commands);
+    std::stringstream expected;
+    range_queries::start<RB::Tree<int>, int>(plain_in, expected);
+
+    {
+        Logged tree(dir.string(), policy);
+
+        std::stringstream logged_in(commands);
+        std::stringstream logged_out;
+        range_queries::start<Logged, int>(logged_in, logged_out, tree);
+
+        EXPECT_EQ(logged_out.str(), expected.str());
+    }
+
+    /* Keys pushed out by the window stay out after recovery. */
+    Logged recovered(dir.string(), policy);
+
+    EXPECT_TRUE(recovered.tree().verify());
+    EXPECT_EQ(count(recovered.tree()), 3);
+    EXPECT_EQ(recovered.range_count(9, 13), 2u);
+}
+
+TEST_F(WalTest, replays_erases_and_bursts)
+{
+    std::vector<int> burst = {20, 21, 22, 23, 24};
+
+    {
+        Logged tree(dir.string(), policy);
+        for (int key = 0; key < 10; ++key)
+            tree.insert(key);
+
+        EXPECT_EQ(tree.erase(3), 1u);
+        EXPECT_EQ(tree.erase(3), 0u);
+        tree.insert_sorted(burst.begin(), burst.end());
+        EXPECT_EQ(tree.erase(22), 1u);
+    }
+
+    Logged recovered(dir.string(), policy);
+
+    EXPECT_EQ(recovered.size(), 13u);
+    EXPECT_EQ(recovered.rank(10), 9u);
+    EXPECT_EQ(*recovered.select(3), 4);
+    EXPECT_EQ(recovered.range_count(20, 24), 4u);
+}
+
+// ------- command files -------
+
+class CommandFileTest : public ::testing::Test
+{
+  protected:
+    std::string path =
+        (std::filesystem::temp_directory_path() / "rq_command_file_test.bin").string();
+
+    void TearDown() override { std::filesystem::remove(path); }
+
+    /* Converts a text command file the way rq_convert.x does. */
+    template <typename T>
+    void convert(const std::string &text_path)
+    {
+        std::ifstream in(text_path);
+        std::ofstream out(path, std::ios::binary);
+
+        range_queries::command_file::Writer<T> writer(out);
+        range_queries::Command<T> command;
+
+        while (range_queries::read_command(in, command))
+            writer.write(command);
+
+        writer.finish();
+    }
+
+    template <typename Tree, typename T>
+    std::string run()
+    {
+        RB::snapshot::Mapped_File file(path);
+        range_queries::command_file::Reader<T> reader(file, path);
+
+        std::stringstream result;
+        range_queries::start<Tree, T>(reader, result);
+
+        return result.str();
+    }
+};
+
+TEST_F(CommandFileTest, round_trip)
+{
+    std::vector<range_queries::Command<int64_t>> commands;
+
+    std::mt19937 generator(29);
+    std::uniform_int_distribution<int64_t> keys(-(1LL << 62), 1LL << 62);
+    const char options[] = "kqnprwstf";
+
+    for (int id = 0; id < 10000; ++id)
+    {
+        range_queries::Command<int64_t> command;
+        command.option = options[static_cast<size_t>(id) % (sizeof(options) - 1)];
+        command.first = keys(generator);
+        command.second = command.first + id;
+        command.third = keys(generator);
+        command.fourth = -command.third;
+        command.count = static_cast<size_t>(id) * 1000;
+        command.real = id / 7.0;
+        commands.push_back(command);
+    }
+
+    {
+        std::ofstream out(path, std::ios::binary);
+        range_queries::command_file::Writer<int64_t> writer(out);
+
+        for (const auto &command : commands)
+            writer.write(command);
+
+        writer.finish();
+    }
+
+    EXPECT_TRUE(range_queries::command_file::is_command_file(path));
+
+    RB::snapshot::Mapped_File file(path);
+    range_queries::command_file::Reader<int64_t> reader(file, path);
+    range_queries::Command<int64_t> decoded;
+
+    for (const auto &command : commands)
+    {
+        ASSERT_TRUE(reader.next(decoded));
+        ASSERT_EQ(decoded.option, command.option);
+
+        switch (command.option)
+        {
+            case 'k':
+            case 'n':
+                ASSERT_EQ(decoded.first, command.first);
+                break;
+            case 'q':
+            case 'p':
+                ASSERT_EQ(decoded.first, command.first);
+                ASSERT_EQ(decoded.second, command.second);
+                break;
+            case 'r':
+                ASSERT_EQ(decoded.first, command.first);
+                ASSERT_EQ(decoded.second, command.second);
+                ASSERT_EQ(decoded.third, command.third);
+                ASSERT_EQ(decoded.fourth, command.fourth);
+                break;
+            case 'w':
+            case 's':
+                ASSERT_EQ(decoded.count, command.count);
+                break;
+            default:
+                ASSERT_DOUBLE_EQ(decoded.real, command.real);
+        }
+    }
+
+    EXPECT_FALSE(reader.next(decoded));
+}
+
+TEST_F(CommandFileTest, same_answers_as_text)
+{
+    for (std::string name : {"/common/basic_1", "/common/basic_5", "/order/basic_1",
+                             "/window/count_1", "/plane/basic_1"})
+    {
+        std::string test_path = std::string(TEST_DATA_DIR) + "data" + name;
+        convert<int>(test_path + ".dat");
+
+        EXPECT_EQ((run<RB::Tree<int>, int>()),
+                  test_utils::detail::get_answer(test_path + ".ans"))
+            << name;
+    }
+}
+
+TEST_F(CommandFileTest, double_keys)
+{
+    std::string test_path = std::string(TEST_DATA_DIR) + "data/common/basic_2";
+    convert<double>(test_path + ".dat");
+
+    EXPECT_EQ((run<RB::Tree<double>, double>()),
+              test_utils::detail::get_answer(test_path + ".ans"));
+
+    RB::snapshot::Mapped_File file(path);
+    EXPECT_THROW((range_queries::command_file::Reader<int>(file, path)),
+                 std::runtime_error);
+}
+
+TEST_F(CommandFileTest, stays_at_the_end)
+{
+    convert<int>(std::string(TEST_DATA_DIR) + "data/common/basic_1.dat");
+
+    RB::snapshot::Mapped_File file(path);
+    range_queries::command_file::Reader<int> reader(file, path);
+    range_queries::Command<int> command;
+
+    while (reader.next(command))
+        ;
+
+    EXPECT_FALSE(reader.next(command));
+    EXPECT_FALSE(reader.next(command));
+}
+
+TEST_F(CommandFileTest, rejects_truncated_files)
+{
+    convert<int>(std::string(TEST_DATA_DIR) + "data/common/basic_1.dat");
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 5);
+
+    RB::snapshot::Mapped_File file(path);
+    range_queries::command_file::Reader<int> reader(file, path);
+    range_queries::Command<int> command;
+
+    EXPECT_THROW(
+        {
+            while (reader.next(command))
+                ;
+        },
+        std::runtime_error);
+}
+
+// ------- pipelined driver -------
+
+TEST(spsc_ring, keeps_order_across_threads)
+{
+    range_queries::Spsc_Ring<std::vector<int>> ring(4);
+    EXPECT_EQ(ring.capacity(), 4u);
+
+    constexpr int batches = 20000;
+
+    std::thread producer(
+        [&]
+        {
+            double stalled = 0;
+            std::vector<int> batch;
+
+            for (int id = 0; id < batches; ++id)
+            {
+                batch.assign(static_cast<size_t>(id % 7 + 1), id);
+                ASSERT_TRUE(ring.push(batch, stalled));
+            }
+
+            ring.close();
+        });
+
+    double stalled = 0;
+    std::vector<int> batch;
+    int expected = 0;
+
+    while (ring.pop(batch, stalled))
+    {
+        ASSERT_EQ(batch.size(), static_cast<size_t>(expected % 7 + 1));
+        ASSERT_EQ(batch.front(), expected);
+        ++expected;
+    }
+
+    producer.join();
+    EXPECT_EQ(expected, batches);
+
+    /* A closed queue refuses pushes. */
+    EXPECT_FALSE(ring.push(batch, stalled));
+}
+
+TEST(pipelined_range_queries, basic_1)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/common/basic_1", true);
+}
+
+TEST(pipelined_range_queries, basic_5)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/common/basic_5", true);
+}
+
+TEST(pipelined_range_queries, order)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/order/basic_1", true);
+}
+
+TEST(pipelined_range_queries, window)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/window/count_1", true);
+}
+
+TEST(pipelined_range_queries, points_and_rectangles)
+{
+    test_utils::run_test<RB::Tree<int>, int>("/plane/basic_1", true);
+}
+
+TEST(pipelined_range_queries, adaptive)
+{
+    test_utils::run_test<range_queries::Adaptive<int>, int>("/common/basic_4", true);
+}
+
+TEST(pipelined_range_queries, many_batches)
+{
+    std::stringstream input;
+    std::stringstream expected;
+
+    std::mt19937 generator(23);
+    std::uniform_int_distribution<int> keys(0, 100000);
+
+    std::set<int> reference;
+    for (int id = 0; id < 50000; ++id)
+    {
+        int key = keys(generator);
+        input << "k " << key << ' ';
+        reference.insert(key);
+
+        if (id % 3 == 0)
+        {
+            int left = keys(generator);
+            input << "q " << left << ' ' << left + 1000 << ' ';
+            expected << std::distance(reference.lower_bound(left),
+                                      reference.upper_bound(left + 1000))
+                     << ' ';
+        }
+    }
+    expected << std::endl;
+
+    std::stringstream output;
+    range_queries::start<RB::Tree<int>, int>(input, output, true);
+
+    EXPECT_EQ(output.str(), expected.str());
+}
+
+// ------- burst ingest -------
+
+template <typename T>
+void check_sort_unique(std::vector<T> keys, unsigned threads)
+{
+    std::vector<T> expected = keys;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+    range_queries::sort_unique(keys, threads);
+    EXPECT_EQ(keys, expected);
+}
+
+TEST(burst_ingest, sort_unique)
+{
+    std::mt19937_64 generator(31);
+    size_t count = range_queries::parallel_sort_size * 3 + 17;
+
+    std::uniform_int_distribution<int> narrow(-5000, 5000);
+    std::uniform_int_distribution<int64_t> wide(std::numeric_limits<int64_t>::min(),
+                                                std::numeric_limits<int64_t>::max());
+    std::uniform_real_distribution<double> reals(-1e6, 1e6);
+
+    std::vector<int> ints(count);
+    std::vector<int64_t> longs(count);
+    std::vector<double> doubles(count);
+    for (size_t id = 0; id < count; ++id)
+    {
+        ints[id] = narrow(generator);
+        longs[id] = id % 3 == 0 ? longs[id / 2] : wide(generator);
+        doubles[id] = id % 5 == 0 ? 0.5 : reals(generator);
+    }
+
+    for (unsigned threads : {1u, 3u, 4u})
+    {
+        check_sort_unique(ints, threads);
+        check_sort_unique(longs, threads);
+        check_sort_unique(doubles, threads);
+    }
+
+    check_sort_unique(std::vector<int>{}, 4);
+    check_sort_unique(std::vector<int>{7, 7, -7}, 4);
+}
+
+TEST(burst_ingest, radix_sort_skips_shared_bytes)
+{
+    std::mt19937 generator(33);
+    std::uniform_int_distribution<int> keys(0, 4095); // only the low two bytes differ
+
+    std::vector<int> narrow(range_queries::parallel_sort_size * 2);
+    for (int &key : narrow)
+        key = keys(generator);
+
+    std::vector<int> expected = narrow;
+    std::sort(expected.begin(), expected.end());
+
+    for (unsigned threads : {1u, 4u})
+    {
+        std::vector<int> sorted = narrow;
+        EXPECT_EQ(range_queries::detail::radix_sort(sorted, threads), 2u);
+        EXPECT_EQ(sorted, expected);
+    }
+}
+
+TEST(burst_ingest, insert_sorted)
+{
+    RB::Tree<int> tree;
+    std::set<int> reference;
+    std::mt19937 generator(32);
+    std::uniform_int_distribution<int> keys(0, 1 << 20);
+
+    auto insert_batch = [&](size_t count)
+    {
+        std::vector<int> batch(count);
+        for (int &key : batch)
+            key = keys(generator);
+
+        range_queries::sort_unique(batch, 2);
+        tree.insert_sorted(batch.begin(), batch.end());
+        reference.insert(batch.begin(), batch.end());
+
+        ASSERT_TRUE(tree.verify());
+        ASSERT_TRUE(std::equal(tree.begin(), tree.end(), reference.begin(),
+                               reference.end()));
+    };
+
+    insert_batch(1000);  // into an empty tree: bulk build
+    insert_batch(50);    // small: one insert per key
+    insert_batch(20000); // large: merged and rebuilt
+
+    RB::Tree<int> snapshot = tree.clone();
+    std::vector<int> kept(snapshot.begin(), snapshot.end());
+
+    insert_batch(300);
+    EXPECT_TRUE(std::equal(snapshot.begin(), snapshot.end(), kept.begin(), kept.end()));
+
+    /* Keys already in the tree are skipped on both paths. */
+    std::vector<int> present(reference.begin(), reference.end());
+    tree.insert_sorted(present.begin(), present.begin() + 10);
+    tree.insert_sorted(present.begin(), present.end());
+    EXPECT_EQ(tree.size(), reference.size());
+    EXPECT_TRUE(tree.verify());
+}
+
+/* Runs of inserts long enough for bursts, with and without a window; the
+ * answers must match an engine that inserts one key at a time. */
+TEST(burst_ingest, same_answers)
+{
+    std::stringstream input;
+    std::mt19937 generator(33);
+    std::uniform_int_distribution<int> keys(-100000, 100000);
+    std::uniform_int_distribution<int> runs(
+        0, 4 * static_cast<int>(range_queries::burst_min_keys));
+
+    for (int round = 0; round < 12; ++round)
+    {
+        if (round == 8)
+            input << "w 3000 ";
+        if (round == 10)
+            input << "w 0 ";
+
+        for (int id = runs(generator); id > 0; --id)
+            input << "k " << keys(generator) << ' ';
+
+        for (int id = 0; id < 20; ++id)
+        {
+            int left = keys(generator);
+            input << "q " << left << ' ' << left + 20000 << " n " << left << ' ';
+        }
+    }
+
+    std::string commands = input.str();
+
+    std::stringstream sequential_in(commands);
+    std::stringstream expected;
+    range_queries::start<std::set<int>, int>(sequential_in, expected);
+
+    for (bool pipelined : {false, true})
+    {
+        std::stringstream burst_in(commands);
+        std::stringstream output;
+        range_queries::start<RB::Tree<int>, int>(burst_in, output, pipelined);
+
+        EXPECT_EQ(output.str(), expected.str()) << "pipelined: " << pipelined;
+    }
+}
+
+// ------- query cache -------
+
+TEST(query_cache, table)
+{
+    range_queries::Query_Cache<int> cache(100);
+    EXPECT_EQ(cache.capacity(), 128u);
+
+    EXPECT_FALSE(cache.find(1, 2));
+    cache.store(1, 2, 7);
+    cache.store(2, 1, 0);
+    EXPECT_EQ(cache.find(1, 2), 7u);
+    EXPECT_EQ(cache.find(2, 1), 0u);
+
+    cache.store(1, 2, 8);
+    EXPECT_EQ(cache.find(1, 2), 8u);
+
+    cache.invalidate();
+    EXPECT_FALSE(cache.find(1, 2));
+
+    /* Overfilled, it evicts but never answers wrong. */
+    for (int left = 0; left < 1000; ++left)
+        cache.store(left, left + 10, static_cast<size_t>(left));
+    for (int left = 0; left < 1000; ++left)
+    {
+        if (auto count = cache.find(left, left + 10))
+        {
+            ASSERT_EQ(*count, static_cast<size_t>(left));
+        }
+    }
+
+    const range_queries::Cache_Stats &stats = cache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 1005u);
+    EXPECT_GE(stats.hits, 128u);
+    EXPECT_EQ(stats.invalidations, 1u);
+}
+
+TEST(query_cache, invalidated_by_changes)
+{
+    RB::Tree<int> tree;
+    range_queries::Cached<RB::Tree<int>, int> cached(tree, 64);
+
+    for (int key = 0; key < 100; ++key)
+        cached.insert(key);
+
+    EXPECT_EQ(cached.range_count(10, 19), 10u);
+    EXPECT_EQ(cached.range_count(10, 19), 10u);
+    EXPECT_EQ(cached.stats().hits, 1u);
+
+    /* A key already there changes nothing. */
+    size_t invalidations = cached.stats().invalidations;
+    cached.insert(15);
+    EXPECT_EQ(cached.stats().invalidations, invalidations);
+    EXPECT_EQ(cached.range_count(10, 19), 10u);
+    EXPECT_EQ(cached.stats().hits, 2u);
+
+    cached.insert(1000);
+    EXPECT_EQ(cached.stats().invalidations, invalidations + 1);
+    EXPECT_EQ(cached.range_count(10, 1000), 91u);
+    EXPECT_EQ(cached.stats().hits, 2u);
+}
+
+/* Repeated queries between inserts, duplicates and a count window: cached
+ * answers must match uncached ones. */
+TEST(query_cache, same_answers)
+{
+    std::stringstream input;
+    std::mt19937 generator(41);
+    std::uniform_int_distribution<int> keys(0, 2000);
+
+    for (int round = 0; round < 300; ++round)
+    {
+        if (round == 200)
+            input << "w 500 ";
+
+        input << "k " << keys(generator) << " k " << round % 50 << ' ';
+
+        for (int id = 0; id < 5; ++id)
+            input << "q " << 100 * id << ' ' << 100 * id + 450 << ' ';
+    }
+
+    std::string commands = input.str();
+
+    std::stringstream plain_in(commands);
+    std::stringstream expected;
+    range_queries::start<std::set<int>, int>(plain_in, expected);
+
+    std::stringstream rb_in(commands);
+    std::stringstream rb_out;
+    range_queries::start<RB::Tree<int>, int>(rb_in, rb_out, false, 256);
+    EXPECT_EQ(rb_out.str(), expected.str());
+
+    std::stringstream set_in(commands);
+    std::stringstream set_out;
+    range_queries::start<std::set<int>, int>(set_in, set_out, true, 256);
+    EXPECT_EQ(set_out.str(), expected.str());
+}
+
+// ------- profiling -------
+
+TEST(profiling, width_buckets)
+{
+    using range_queries::Profiler;
+
+    EXPECT_EQ(Profiler::width_bucket(5, 4), 0u);
+    EXPECT_EQ(Profiler::width_bucket(5, 5), 1u);
+    EXPECT_EQ(Profiler::width_bucket(5, 14), 2u);
+    EXPECT_EQ(Profiler::width_bucket(0, 10), 3u);
+    EXPECT_EQ(Profiler::width_bucket(std::numeric_limits<int>::min(),
+                                     std::numeric_limits<int>::max()),
+              Profiler::width_decades + 1);
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_EQ(Profiler::width_bucket(0.0, nan), 0u);
+    EXPECT_EQ(Profiler::width_bucket(0.0, 0.5), 1u);
+
+    EXPECT_EQ(Profiler::width_bucket(std::string("b"), std::string("a")), 0u);
+    EXPECT_EQ(Profiler::width_bucket(std::string("a"), std::string("b")),
+              Profiler::width_decades + 2);
+}
+
+/* Every command lands in one histogram, bursts included, and profiling
+ * changes no answer. */
+TEST(profiling, counts_commands)
+{
+    std::stringstream input;
+    std::mt19937 generator(44);
+    std::uniform_int_distribution<int> keys(0, 1000000);
+
+    size_t inserts = 3 * range_queries::burst_min_keys;
+    for (size_t id = 0; id < inserts; ++id)
+        input << "k " << keys(generator) << ' ';
+    for (int id = 0; id < 100; ++id)
+        input << "q " << 1000 * id << ' ' << 1000 * id + 50000 << ' ';
+    input << "q 10 1 s 5 n 500 k 7 ";
+
+    std::string commands = input.str();
+
+    std::stringstream plain_in(commands);
+    std::stringstream expected;
+    range_queries::start<RB::Tree<int>, int>(plain_in, expected);
+
+    for (bool pipelined : {false, true})
+    {
+        range_queries::Profiler profiler;
+        std::stringstream profiled_in(commands);
+        std::stringstream output;
+        range_queries::start<RB::Tree<int>, int>(profiled_in, output, pipelined, 0,
+                                                 &profiler);
+
+        EXPECT_EQ(output.str(), expected.str());
+        EXPECT_EQ(profiler.inserts().count(), inserts + 1);
+        EXPECT_EQ(profiler.queries(0).count(), 1u);
+        EXPECT_EQ(profiler.queries(6).count(), 100u);
+        EXPECT_EQ(profiler.others().count(), 2u);
+        EXPECT_EQ(profiler.commands(), inserts + 104);
+
+        std::stringstream report;
+        profiler.report(report);
+        EXPECT_NE(report.str().find("q width < 1e5: 100 commands"), std::string::npos)
+            << report.str();
+    }
+}
+
+TEST(profiling, snapshots)
+{
+    std::stringstream snapshots;
+    range_queries::Profiler profiler(snapshots, std::chrono::milliseconds(0));
+
+    std::stringstream input("k 1 k 2 q 1 2");
+    std::stringstream output;
+    range_queries::start<RB::Tree<int>, int>(input, output, false, 0, &profiler);
+
+    std::string line;
+    std::string last;
+    size_t lines = 0;
+    while (std::getline(snapshots, line))
+    {
+        ++lines;
+        EXPECT_EQ(line.rfind("{\"seconds\": ", 0), 0u) << line;
+        EXPECT_EQ(line.back(), '}') << line;
+        last = line;
+    }
+
+    EXPECT_EQ(lines, 2u); // the two inserts are flushed as one burst
+    EXPECT_NE(last.find("\"q_by_width\": [{\"width\": \"width < 1e1\""),
+              std::string::npos)
+        << last;
+}
+
+// ------- server -------
+
+TEST(histogram, percentiles)
+{
+    range_queries::Latency_Histogram histogram;
+
+    for (uint64_t value = 1; value <= 1000; ++value)
+        histogram.record(value);
+
+    EXPECT_EQ(histogram.count(), 1000);
+    EXPECT_EQ(histogram.max(), 1000);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.5)), 500, 500 * 0.07);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile(0.99)), 990, 990 * 0.07);
+    EXPECT_EQ(histogram.percentile(1.0), 1000);
+}
+
+#ifdef __linux__
+
+namespace
+{
+
+std::string receive(int fd, size_t size)
+{
+    std::string answer(size, '\0');
+    size_t received = 0;
+
+    while (received < size)
+    {
+        ssize_t chunk = ::recv(fd, answer.data() + received, size - received, 0);
+        if (chunk <= 0)
+            break;
+        received += static_cast<size_t>(chunk);
+    }
+
+    answer.resize(received);
+    return answer;
+}
+
+} // namespace
+
+TEST(server, text_and_binary_sessions)
+{
+    namespace server = range_queries::server;
+
+    server::Server_Options options;
+    options.address = range_queries::net::parse_address(
+        "unix:" + (std::filesystem::temp_directory_path() / "rq_test.sock").string());
+    options.threads = 2;
+
+    RB::Tree<int> tree;
+    std::atomic<bool> stop{false};
+
+    server::Server<RB::Tree<int>, int> instance(options, tree);
+    std::thread loop([&] { instance.run(stop); });
+
+    int text = range_queries::net::connect_to(options.address);
+    std::string first = "k 10 k 20 q 8 3";
+    std::string second = "1 q 6 9 k 30 k 40 q 15 40 ";
+
+    range_queries::net::send_all(text, first.data(), first.size());
+    range_queries::net::send_all(text, second.data(), second.size());
+    EXPECT_EQ(receive(text, 6), "2 0 3 ");
+    ::close(text);
+
+    int binary = range_queries::net::connect_to(options.address);
+    std::string frames(1, server::binary_magic);
+    int keys[] = {15, 50};
+    frames += 'q';
+    frames.append(reinterpret_cast<const char *>(keys), sizeof(keys));
+
+    range_queries::net::send_all(binary, frames.data(), frames.size());
+
+    uint64_t count = 0;
+    std::string answer = receive(binary, sizeof(count));
+    ASSERT_EQ(answer.size(), sizeof(count));
+    std::memcpy(&count, answer.data(), sizeof(count));
+    EXPECT_EQ(count, 3);
+    ::close(binary);
+
+    stop.store(true);
+    loop.join();
+
+    EXPECT_EQ(tree.size(), 4);
+}
+
+TEST(server, reports_bad_commands_and_goes_on)
+{
+    namespace server = range_queries::server;
+
+    server::Server_Options options;
+    options.address = range_queries::net::parse_address(
+        "unix:" + (std::filesystem::temp_directory_path() / "rq_test_bad.sock").string());
+    options.threads = 1;
+
+    RB::Tree<int> tree;
+    std::atomic<bool> stop{false};
+
+    server::Server<RB::Tree<int>, int> instance(options, tree);
+    std::thread loop([&] { instance.run(stop); });
+
+    int text = range_queries::net::connect_to(options.address);
+    std::string commands = "k 10 q 5 x k 20 q 0 30 ";
+    std::string expected = "error: bad argument to 'q'\n2 ";
+
+    range_queries::net::send_all(text, commands.data(), commands.size());
+    EXPECT_EQ(receive(text, expected.size()), expected);
+    ::close(text);
+
+    stop.store(true);
+    loop.join();
+
+    EXPECT_EQ(tree.size(), 2);
+}
+
+TEST(server, streams_input_longer_than_a_turn)
+{
+    namespace server = range_queries::server;
+
+    server::Server_Options options;
+    options.address = range_queries::net::parse_address(
+        "unix:" + (std::filesystem::temp_directory_path() / "rq_test_stream.sock").string());
+    options.threads = 1;
+
+    RB::Tree<int> tree;
+    std::atomic<bool> stop{false};
+
+    server::Server<RB::Tree<int>, int> instance(options, tree);
+    std::thread loop([&] { instance.run(stop); });
+
+    std::string commands;
+    for (int key = 0; key < 200000; ++key)
+        commands += "k " + std::to_string(key) + ' ';
+    commands += "q 0 1000000 ";
+
+    int text = range_queries::net::connect_to(options.address);
+    EXPECT_TRUE(range_queries::net::send_all(text, commands.data(), commands.size()));
+    EXPECT_EQ(receive(text, 7), "200000 ");
+    ::close(text);
+
+    /* A command that never ends is cut off instead of buffered. */
+    std::string endless(4 << 20, 'x');
+
+    int flood = range_queries::net::connect_to(options.address);
+    range_queries::net::send_all(flood, endless.data(), endless.size());
+    EXPECT_EQ(receive(flood, 1), "");
+    ::close(flood);
+
+    stop.store(true);
+    loop.join();
+
+    EXPECT_EQ(tree.size(), 200000);
+}
+
+#endif // __linux__
+
 #ifdef ENABLE_BD_TESTS
 
 #endif
@@ -11,7 +11,7 @@ namespace detail
 {
 
 template <typename Tree, typename T>
-std::string get_result(std::string_view file_name)
+std::string get_result(std::string_view file_name, bool pipelined)
 {
     std::ifstream test_data(file_name.data());
     if (!test_data.is_open())
@@ -22,7 +22,7 @@ std::string get_result(std::string_view file_name)
 
     std::stringstream result;
 
-    range_queries::start<Tree, T>(test_data, result);
+    range_queries::start<Tree, T>(test_data, result, pipelined);
 
     return result.str();
 }